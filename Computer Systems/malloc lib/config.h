@@ -101,9 +101,11 @@
 #define UTIL_WEIGHT .61
 
 /*
- * Alignment requirement in bytes (either 4 or 8)
+ * Alignment requirement in bytes (8, or 16 with -DALIGNMENT=16)
  */
+#ifndef ALIGNMENT
 #define ALIGNMENT 8
+#endif
 
 /*
  * Maximum heap size in bytes
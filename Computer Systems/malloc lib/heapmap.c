@@ -0,0 +1,244 @@
+/*
+ * heapmap.c - Render a heap layout written by mm_heapdump() (see
+ * mdriver -H) as a fragmentation map and a histogram of free block
+ * sizes, one of each for every arena in the file.
+ *
+ * In the map each character stands for the same number of heap bytes:
+ * '#' all allocated, 's' mostly slabs, '+' mostly allocated, '-' mostly
+ * free and '.' all free. Two maps of the same trace built with different
+ * placement policies can be compared side by side.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define MAXLINE 1024
+#define BUCKETS 64 /* Free block size buckets, one per power of two */
+#define MAX_DIM 4096 /* Largest map width or number of rows */
+
+/* Heap bytes of each kind that fall into one character of the map */
+typedef struct {
+    size_t alloc; /* allocated block bytes */
+    size_t slab;  /* slab bytes */
+    size_t free;  /* free block bytes */
+} cell_t;
+
+/* Layout of the arena being read */
+typedef struct {
+    int id;
+    size_t heap_size;           /* bytes of heap, from the arena line */
+    size_t cell_size;           /* heap bytes per map character */
+    int ncells;
+    cell_t *cells;
+    size_t count[3], bytes[3];  /* blocks and bytes by state a, s, f */
+    size_t largest_free;
+    size_t free_count[BUCKETS]; /* free blocks by log2 of their size */
+    size_t free_bytes[BUCKETS];
+} arena_t;
+
+static int width = 64; /* characters per map line */
+static int rows = 16;  /* map lines */
+
+/*
+ * usage - Explain the command line arguments
+ */
+static void usage(void)
+{
+    fprintf(stderr, "Usage: heapmap [-h] [-w <width>] [-r <rows>] <file>\n");
+    fprintf(stderr, "Options\n");
+    fprintf(stderr, "\t-h         Print this message.\n");
+    fprintf(stderr, "\t-w <n>     Map characters per line, up to 4096 (default 64).\n");
+    fprintf(stderr, "\t-r <n>     Map lines, up to 4096 (default 16).\n");
+    fprintf(stderr, "\t<file>     Heap layout from mdriver -H.\n");
+}
+
+/*
+ * parse_dim - Return the map width or number of rows given in s, or
+ * print the usage message and exit if s is not a number from 1 to MAX_DIM
+ */
+static int parse_dim(const char *s)
+{
+    char *end;
+    long n = strtol(s, &end, 10);
+
+    if (end == s || *end != '\0' || n <= 0 || n > MAX_DIM) {
+        usage();
+        exit(1);
+    }
+    return (int)n;
+}
+
+/*
+ * log2_floor - Return the power of two bucket of size
+ */
+static int log2_floor(size_t size)
+{
+    return 63 - __builtin_clzl(size);
+}
+
+/*
+ * arena_start - Start a new arena of heap_size bytes
+ */
+static void arena_start(arena_t *a, int id, size_t heap_size)
+{
+    memset(a, 0, sizeof(*a));
+    a->id = id;
+    a->heap_size = heap_size;
+    a->ncells = width * rows;
+    a->cell_size = (heap_size + a->ncells - 1) / a->ncells;
+    if (a->cell_size == 0)
+        a->cell_size = 1;
+    if ((a->cells = calloc(a->ncells, sizeof(cell_t))) == NULL) {
+        fprintf(stderr, "heapmap: out of memory\n");
+        exit(1);
+    }
+}
+
+/*
+ * arena_block - Add a block at offset of size bytes in the given state
+ */
+static void arena_block(arena_t *a, size_t offset, size_t size, char state)
+{
+    size_t end = offset + size, lo, hi, n;
+    int kind = (state == 'a') ? 0 : (state == 's') ? 1 : 2;
+    int c;
+
+    a->count[kind]++;
+    a->bytes[kind] += size;
+    if (kind == 2) {
+        if (size > a->largest_free)
+            a->largest_free = size;
+        a->free_count[log2_floor(size)]++;
+        a->free_bytes[log2_floor(size)] += size;
+    }
+
+    /* Share the block out over the characters it overlaps */
+    for (c = offset / a->cell_size; c < a->ncells; c++) {
+        lo = (size_t)c * a->cell_size;
+        hi = lo + a->cell_size;
+        if (lo >= end)
+            break;
+        n = ((hi < end) ? hi : end) - ((lo > offset) ? lo : offset);
+        if (kind == 0)
+            a->cells[c].alloc += n;
+        else if (kind == 1)
+            a->cells[c].slab += n;
+        else
+            a->cells[c].free += n;
+    }
+}
+
+/*
+ * cell_char - Return the map character of cell c
+ */
+static char cell_char(const cell_t *c)
+{
+    size_t used = c->alloc + c->slab;
+
+    if (used + c->free == 0)
+        return ' ';
+    if (c->free == 0)
+        return (c->slab > c->alloc) ? 's' : '#';
+    if (used == 0)
+        return '.';
+    return (used >= c->free) ? ((c->slab > c->alloc) ? 's' : '+') : '-';
+}
+
+/*
+ * arena_print - Print the summary, map and free block histogram
+ */
+static void arena_print(arena_t *a)
+{
+    size_t maxbytes = 0;
+    int b, c;
+
+    printf("Arena %d: %zu heap bytes\n", a->id, a->heap_size);
+    printf("  %zu allocated blocks of %zu bytes, %zu slabs of %zu bytes\n",
+           a->count[0], a->bytes[0], a->count[1], a->bytes[1]);
+    printf("  %zu free blocks of %zu bytes, the largest %zu bytes",
+           a->count[2], a->bytes[2], a->largest_free);
+    if (a->bytes[2])
+        printf(" (%.1f%% fragmented)",
+               100.0 * (a->bytes[2] - a->largest_free) / a->bytes[2]);
+    printf("\n\n  Map, %zu bytes per character:\n", a->cell_size);
+    for (c = 0; c < a->ncells; c++) {
+        if (c % width == 0)
+            printf("  |");
+        putchar(cell_char(&a->cells[c]));
+        if (c % width == width - 1)
+            printf("|\n");
+    }
+
+    printf("\n  Free blocks by size:\n");
+    for (b = 0; b < BUCKETS; b++)
+        if (a->free_bytes[b] > maxbytes)
+            maxbytes = a->free_bytes[b];
+    for (b = 0; b < BUCKETS; b++) {
+        if (a->free_count[b] == 0)
+            continue;
+        printf("  %9zu+ %7zu %10zu  ", (size_t)1 << b,
+               a->free_count[b], a->free_bytes[b]);
+        for (c = 0; c < (int)(40 * a->free_bytes[b] / maxbytes) || c == 0; c++)
+            putchar('*');
+        putchar('\n');
+    }
+    printf("\n");
+    free(a->cells);
+    a->cells = NULL;
+}
+
+int main(int argc, char **argv)
+{
+    char line[MAXLINE];
+    arena_t arena;
+    size_t offset, size, heap_size;
+    char state;
+    int c, id, class;
+    FILE *fp;
+
+    while ((c = getopt(argc, argv, "hw:r:")) != EOF) {
+        switch (c) {
+        case 'w':
+            width = parse_dim(optarg);
+            break;
+        case 'r':
+            rows = parse_dim(optarg);
+            break;
+        case 'h':
+            usage();
+            exit(0);
+        default:
+            usage();
+            exit(1);
+        }
+    }
+    if (optind != argc - 1) {
+        usage();
+        exit(1);
+    }
+    if ((fp = fopen(argv[optind], "r")) == NULL) {
+        fprintf(stderr, "heapmap: could not open %s\n", argv[optind]);
+        exit(1);
+    }
+
+    arena.cells = NULL;
+    while (fgets(line, MAXLINE, fp) != NULL) {
+        if (sscanf(line, "arena %d %zu", &id, &heap_size) == 2) {
+            if (arena.cells)
+                arena_print(&arena);
+            arena_start(&arena, id, heap_size);
+        }
+        else if (arena.cells && sscanf(line, "%zu %zu %c %d",
+                                       &offset, &size, &state, &class) == 4)
+            arena_block(&arena, offset, size, state);
+        else {
+            fprintf(stderr, "heapmap: bad line: %s", line);
+            exit(1);
+        }
+    }
+    if (arena.cells)
+        arena_print(&arena);
+    fclose(fp);
+    return 0;
+}
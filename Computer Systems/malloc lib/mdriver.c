@@ -9,6 +9,7 @@
  */
 #include <assert.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <float.h>
 #include <setjmp.h>
 #include <signal.h>
@@ -18,12 +19,20 @@
 #include <string.h>
 #include <time.h>
 #include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
 
 
 #include "mm.h"
 #include "memlib.h"
 #include "fsecs.h"
+#include "ftimer.h"
+#include "clock.h"
 #include "config.h"
+#include "trace.h"
 
 /**********************
  * Constants and macros
@@ -54,29 +63,31 @@
  * Remember that index (-1) is the null pointer.
  */
 
-/* Records the extent of each block's payload */
+/*
+ * Records the extent of each block's payload. The ranges of a trace form
+ * a treap: a binary search tree by lo that is also a heap by prio, which
+ * keeps it balanced. Payloads never overlap, so a search by address
+ * finds any range a new payload would overlap.
+ */
 typedef struct range_t {
     char *lo;              /* low payload address */
     char *hi;              /* high payload address */
-    struct range_t *next;  /* next list element */
+    struct range_t *left;  /* ranges below lo */
+    struct range_t *right; /* ranges above hi */
+    unsigned prio;         /* hash of lo, at most that of the parent */
     int index;             /* same index as free; for debugging */
 } range_t;
 
-/* Characterizes a single trace operation (allocator request) */
-typedef struct {
-    enum { ALLOC, FREE, REALLOC } type; /* type of request */
-    int index;                        /* index for free() to use later */
-    size_t size;                      /* byte size of alloc/realloc request */
-} traceop_t;
-
 /* Holds the information for one trace file*/
 typedef struct {
     char filename[MAXLINE];
-    int ignore_ranges;   /* don't check ranges (i.e. this is too big) */
+    int ignore_ranges;   /* header flag, unused now ranges are cheap to check */
     int num_ids;         /* number of alloc/realloc ids */
     int num_ops;         /* number of distinct requests */
     int weight;          /* weight for this trace (unused) */
     traceop_t *ops;      /* array of requests */
+    void *map;           /* compiled trace file holding ops, if mapped */
+    size_t map_len;      /* length of that mapping */
     char **blocks;       /* array of ptrs returned by malloc/realloc... */
     size_t *block_sizes; /* ... and a corresponding array of payload sizes */
     int *block_rand_base;/* index into random_data, if debug is on */
@@ -92,6 +103,16 @@ typedef struct {
     range_t *ranges;
 } speed_t;
 
+/* Latencies of one type of request, in cycles, set by -L. Bucket b of
+   the histogram holds the requests of lat_low(b) up to lat_low(b+1)
+   cycles: four buckets to each power of two */
+#define LAT_BUCKETS 256
+typedef struct {
+    unsigned long count;              /* requests timed */
+    unsigned long max;                /* slowest of them */
+    unsigned long hist[LAT_BUCKETS];  /* requests by latency */
+} lat_t;
+
 /* Summarizes the important stats for some malloc function on some trace */
 typedef struct {
     /* set in read_trace */
@@ -105,10 +126,39 @@ typedef struct {
 
     /* defined only for the student malloc package */
     double util;     /* space utilization for this trace (always 0 for libc) */
+    lat_t lat[3];    /* latency of each request type, indexed by traceop_t */
 
     /* Note: secs and util are only defined if valid is true */
 } stats_t;
 
+/* One thread of the threaded replay (-T). Each thread replays its own
+   copy of the trace; with handoff it does not free its blocks itself but
+   passes them to the next thread in out, which frees them */
+#define REPLAY_BATCH 64  /* blocks handed off at a time */
+#define REPLAY_REPS 3    /* runs averaged for each thread count */
+typedef struct replay_t {
+    trace_t *trace;
+    pthread_barrier_t *start; /* released when all threads are ready */
+    struct replay_t *from;    /* thread whose blocks this one frees */
+    int libc;                 /* replay with libc malloc, not mm */
+    int handoff;
+    char **blocks;            /* this thread's blocks, by index */
+    char **out;               /* blocks handed to the next thread */
+    int nout;                 /* entries of out the next thread may free */
+    int done;                 /* set once the thread replayed its trace */
+    int failed;               /* set if an allocation failed */
+} replay_t;
+
+/* Parameters of eval_threads, which ftimer_gettod times */
+typedef struct {
+    trace_t *trace;
+    int nthreads;
+    int libc;
+    int handoff;
+    replay_t *threads;
+    int failed;
+} threads_t;
+
 /* Summarizes the key statistics for a set of traces */
 typedef struct {
     double util;  /* average utilization expressed as a percentage */
@@ -144,6 +194,21 @@ int onetime_flag = 0;
 /* by default, no timeouts */
 static int set_timeout = 0;
 
+/* If set, print the allocator statistics after each trace (set by -S) */
+static int print_stats = 0;
+
+/* If set, write the heap layout of each trace to this directory (-H) */
+static char *heapdir = NULL;
+
+/* Number of worker processes that check traces at once (set by -j) */
+static int jobs = 1;
+
+/* If set, time each request of the traces on its own (set by -L) */
+static int latency = 0;
+
+/* If set, replay the traces in 1 up to this many threads (set by -T) */
+static int max_threads = 0;
+
 /* Directory where default tracefiles are found */
 static char tracedir[MAXLINE] = TRACEDIR;
 
@@ -167,6 +232,7 @@ static int add_range(range_t **ranges, char *lo, int size,
                      const trace_t *trace, int opnum, int index);
 static void remove_range(range_t **ranges, char *lo);
 static void clear_ranges(range_t **ranges);
+static void check_ranges(const trace_t *trace, int opnum, const range_t *r);
 
 /* These functions implement the debugging code */
 static void init_random_data(void);
@@ -188,9 +254,18 @@ static void eval_libc_speed(void *ptr);
 static int eval_mm_valid(trace_t *trace, range_t **ranges);
 static double eval_mm_util(trace_t *trace, int tracenum);
 static void eval_mm_speed(void *ptr);
+static void eval_mm_latency(trace_t *trace, stats_t *stats);
+static void dump_mm_heap(trace_t *trace, int tracenum);
+static void eval_threads(void *ptr);
+static void run_threads(int num_tracefiles, const char *tracedir,
+                        char **tracefiles, stats_t *mm_stats, int run_libc);
+static int check_trace(trace_t *trace, stats_t *stats, int tracenum,
+                       range_t **ranges);
 
 /* Various helper routines */
 static void printresults(int n, stats_t *stats, sum_stats_t *sumstats);
+static void printmmstats(const char *filename);
+static void printlatency(int n, stats_t *stats);
 static void usage(void);
 static void malloc_error(const trace_t *trace, int opnum, const char *fmt, ...)
     __attribute__((format(printf, 3,4)));
@@ -208,6 +283,141 @@ static void timeout_handler(int sig __attribute__((unused))) {
     longjmp(timeout_jmpbuf, 1);
 }
 
+/* Size of a trace file, used to start the biggest traces first */
+static off_t trace_file_size(const char *tracedir, const char *filename)
+{
+    char path[MAXLINE];
+    struct stat st;
+
+    snprintf(path, sizeof(path), "%s%s", tracedir, filename);
+    return (stat(path, &st) == 0) ? st.st_size : 0;
+}
+
+/*
+ * run_tests_parallel - Check the traces for correctness and utilization
+ *     in up to jobs worker processes at once, each with its own simulated
+ *     memory system, starting the biggest traces first. The workers
+ *     write their results to a shared stats array. Once all of them have
+ *     exited, the valid traces are timed one after another in this
+ *     process, so the throughput numbers are not disturbed by the others.
+ */
+static void run_tests_parallel(int num_tracefiles, const char *tracedir,
+                               char **tracefiles, stats_t *mm_stats,
+                               range_t *ranges, speed_t *speed_params)
+{
+    stats_t *shared;
+    off_t *sizes;
+    pid_t *pids;
+    int *order;
+    volatile int i, next = 0, running = 0, timing = 0;
+    int j, k, status, tmp;
+    pid_t pid;
+
+    shared = mmap(NULL, num_tracefiles * sizeof(stats_t),
+                  PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (shared == MAP_FAILED)
+        unix_error("mmap failed in run_tests_parallel");
+    memset(shared, 0, num_tracefiles * sizeof(stats_t));
+    if ((order = calloc(num_tracefiles, sizeof(int))) == NULL ||
+        (sizes = calloc(num_tracefiles, sizeof(off_t))) == NULL ||
+        (pids = calloc(num_tracefiles, sizeof(pid_t))) == NULL)
+        unix_error("calloc failed in run_tests_parallel");
+
+    /* Order the traces biggest first, so a large one does not start last */
+    for (j = 0; j < num_tracefiles; j++) {
+        order[j] = j;
+        sizes[j] = trace_file_size(tracedir, tracefiles[j]);
+    }
+    for (j = 1; j < num_tracefiles; j++) {
+        tmp = order[j];
+        for (k = j; k > 0 && sizes[order[k-1]] < sizes[tmp]; k--)
+            order[k] = order[k-1];
+        order[k] = tmp;
+    }
+
+    /* A timeout stops the workers and leaves the rest of the traces
+       invalid */
+    if (setjmp(timeout_jmpbuf) != 0) {
+        for (j = 0; j < num_tracefiles; j++)
+            if (pids[j] > 0) {
+                kill(pids[j], SIGKILL);
+                waitpid(pids[j], NULL, 0);
+                shared[j].valid = 0;
+            }
+        for (j = timing ? i : 0; j < num_tracefiles; j++)
+            mm_stats[j].valid = 0;
+        goto out;
+    }
+
+    if (verbose > 1)
+        printf("Checking %d traces in %d processes\n", num_tracefiles, jobs);
+    while (next < num_tracefiles || running > 0) {
+        while (next < num_tracefiles && running < jobs) {
+            j = order[next++];
+            if ((pid = fork()) < 0)
+                unix_error("fork failed in run_tests_parallel");
+            if (pid == 0) {
+                /* Hold back the output of the worker until it exits, so
+                   that of different traces is not interleaved */
+                setvbuf(stdout, NULL, _IOFBF, 1 << 16);
+                mem_init();
+                trace_t *trace = read_trace(&shared[j], tracedir,
+                                            tracefiles[j]);
+                check_trace(trace, &shared[j], j, &ranges);
+                free_trace(trace);
+                mem_deinit();
+                exit(errors != 0);
+            }
+            pids[j] = pid;
+            running++;
+        }
+
+        if ((pid = wait(&status)) < 0)
+            unix_error("wait failed in run_tests_parallel");
+        for (j = 0; j < num_tracefiles && pids[j] != pid; j++)
+            ;
+        if (j == num_tracefiles)
+            continue;
+        pids[j] = 0;
+        running--;
+        if (WIFSIGNALED(status)) {
+            fprintf(stderr, "ERROR: checking %s%s died of signal %d\n",
+                    tracedir, tracefiles[j], WTERMSIG(status));
+            shared[j].valid = 0;
+            errors++;
+        }
+        else if (WEXITSTATUS(status) != 0) {
+            shared[j].valid = 0;
+            errors++;
+        }
+    }
+    memcpy(mm_stats, shared, num_tracefiles * sizeof(stats_t));
+
+    /* Time the valid traces one at a time, with no workers running */
+    timing = 1;
+    for (i = 0; i < num_tracefiles; i++) {
+        if (!mm_stats[i].valid)
+            continue;
+        mem_init();
+        trace_t *trace = read_trace(&mm_stats[i], tracedir, tracefiles[i]);
+        speed_params->trace = trace;
+        speed_params->ranges = ranges;
+        if (verbose > 1)
+            printf("Timing %s\n", trace->filename);
+        mm_stats[i].secs = fsecs(eval_mm_speed, speed_params);
+        if (latency)
+            eval_mm_latency(trace, &mm_stats[i]);
+        free_trace(trace);
+        mem_deinit();
+    }
+
+ out:
+    munmap(shared, num_tracefiles * sizeof(stats_t));
+    free(order);
+    free(sizes);
+    free(pids);
+}
+
 /* Run the tests; return the number of tests run (may be less than
    num_tracefiles, if there's a timeout) */
 static void run_tests(int num_tracefiles, const char *tracedir,
@@ -216,6 +426,12 @@ static void run_tests(int num_tracefiles, const char *tracedir,
     volatile int i;
     volatile int timed_out = 0;
 
+    if (jobs > 1 && num_tracefiles > 1 && !onetime_flag) {
+        run_tests_parallel(num_tracefiles, tracedir, tracefiles, mm_stats,
+                           ranges, speed_params);
+        return;
+    }
+
     for (i=0; i < num_tracefiles; i++) {
         /* initialize simulated memory system in memlib.c *
          * start each trace with a clean system */
@@ -233,9 +449,7 @@ static void run_tests(int num_tracefiles, const char *tracedir,
         if(timed_out) {
             mm_stats[i].valid = 0;
         } else {
-            if (verbose > 1)
-                printf("Checking mm_malloc for correctness, ");
-            mm_stats[i].valid = eval_mm_valid(trace, &ranges);
+            check_trace(trace, &mm_stats[i], i, &ranges);
 
             if (onetime_flag) {
                 free_trace(trace);
@@ -243,14 +457,13 @@ static void run_tests(int num_tracefiles, const char *tracedir,
             }
         }
         if (mm_stats[i].valid) {
-            if (verbose > 1)
-                printf("efficiency, ");
-            mm_stats[i].util = eval_mm_util(trace, i);
             speed_params->trace = trace;
             speed_params->ranges = ranges;
             if (verbose > 1)
                 printf("and performance.\n");
             mm_stats[i].secs = fsecs(eval_mm_speed, speed_params);
+            if (latency)
+                eval_mm_latency(trace, &mm_stats[i]);
         }
 
         free_trace(trace);
@@ -290,7 +503,7 @@ int main(int argc, char **argv)
     /*
      * Read and interpret the command line arguments
      */
-    while ((c = getopt(argc, argv, "d:f:c:s:t:v:hVAlD")) != EOF) {
+    while ((c = getopt(argc, argv, "d:f:c:j:s:t:v:H:T:hVAlDLS")) != EOF) {
         switch (c) {
 
         case 'A': /* Hidden Autolab driver argument */
@@ -348,6 +561,33 @@ int main(int argc, char **argv)
             set_timeout = atoi(optarg);
             break;
 
+        case 'S': /* Print allocator statistics */
+            print_stats = 1;
+            break;
+
+        case 'L': /* Print request latencies */
+            latency = 1;
+            break;
+
+        case 'H': /* Directory to write heap layouts to */
+            heapdir = optarg;
+            break;
+
+        case 'j': /* Check traces in this many processes at once */
+            jobs = atoi(optarg);
+            if (jobs <= 0)
+                jobs = sysconf(_SC_NPROCESSORS_ONLN);
+            break;
+
+        case 'T': /* Replay the traces in up to this many threads */
+            max_threads = atoi(optarg);
+#if !defined(ARENAS) || !ARENAS
+            if (max_threads > 1)
+                app_error("-T %d needs mm.c built with -DARENAS=<n>\n",
+                          max_threads);
+#endif
+            break;
+
         case 'h': /* Print this message */
             usage();
             exit(0);
@@ -441,9 +681,15 @@ int main(int argc, char **argv)
             printf("\nResults for mm malloc:\n");
             printresults(num_tracefiles, mm_stats, &global_mm_sum_stats);
             printf("\n");
+            if (latency)
+                printlatency(num_tracefiles, mm_stats);
         }
     }
 
+    /* Optionally replay the traces in threads */
+    if (max_threads > 0 && !onetime_flag)
+        run_threads(num_tracefiles, tracedir, tracefiles, mm_stats, run_libc);
+
     /* Optionally compare the performance of mm and libc */
     if (run_libc) {
         printf("Comparison with libc malloc: mm/libc = %.0f Kops / %.0f Kops = %.2f\n", 
@@ -569,11 +815,58 @@ int main(int argc, char **argv)
 
 
 /*****************************************************************
- * The following routines manipulate the range list, which keeps
+ * The following routines manipulate the range tree, which keeps
  * track of the extent of every allocated block payload. We use the
- * range list to detect any overlapping allocated blocks.
+ * range tree to detect any overlapping allocated blocks.
  ****************************************************************/
 
+/*
+ * range_insert - Insert range p into the treap t, rotating it up past
+ *     the ranges of lower priority; return the new root
+ */
+static range_t *range_insert(range_t *t, range_t *p)
+{
+    range_t *c;
+
+    if (t == NULL)
+        return p;
+    if (p->lo < t->lo) {
+        c = t->left = range_insert(t->left, p);
+        if (c->prio > t->prio) {
+            t->left = c->right;
+            c->right = t;
+            return c;
+        }
+    }
+    else {
+        c = t->right = range_insert(t->right, p);
+        if (c->prio > t->prio) {
+            t->right = c->left;
+            c->left = t;
+            return c;
+        }
+    }
+    return t;
+}
+
+/*
+ * range_join - Join treaps l and r, all of whose ranges lie below those
+ *     of r; return the new root
+ */
+static range_t *range_join(range_t *l, range_t *r)
+{
+    if (l == NULL)
+        return r;
+    if (r == NULL)
+        return l;
+    if (l->prio > r->prio) {
+        l->right = range_join(l->right, r);
+        return l;
+    }
+    r->left = range_join(l, r->left);
+    return r;
+}
+
 /*
  * add_range - As directed by request opnum in trace tracenum,
  *     we've just called the student's mm_malloc to allocate a block of
@@ -595,24 +888,22 @@ static int add_range(range_t **ranges, char *lo, int size,
         return 0;
     }
 
-    /* The payload must lie within the extent of the heap */
-    if ((lo < (char *)mem_heap_lo()) || (lo > (char *)mem_heap_hi()) ||
-        (hi < (char *)mem_heap_lo()) || (hi > (char *)mem_heap_hi())) {
+    /* The payload must lie within the extent of the heap, or of a
+       region mapped by mem_map */
+    if (!mem_is_heap(lo, hi)) {
         malloc_error(trace, opnum,
                      "Payload (%p:%p) lies outside heap (%p:%p)",
                      lo, hi, mem_heap_lo(), mem_heap_hi());
         return 0;
     }
 
-    /* If we can't afford the linear-time loop, we check less thoroughly and
-       just assume the overlap will be caught by writing random bits. */
-    if(trace->ignore_ranges || debug_mode == DBG_NONE) return 1;
-
+    if(debug_mode == DBG_NONE) return 1;
 
-    /* The payload must not overlap any other payloads */
-    for (p = *ranges;  p != NULL;  p = p->next) {
-        if ((lo >= p->lo && lo <= p-> hi) ||
-            (hi >= p->lo && hi <= p->hi)) {
+    /* The payload must not overlap any other payloads. The search takes
+       logarithmic time, so every trace is checked, whatever its
+       ignore-ranges header says */
+    for (p = *ranges;  p != NULL;  p = (hi < p->lo) ? p->left : p->right) {
+        if (lo <= p->hi && hi >= p->lo) {
             malloc_error(trace, opnum,
                          "Payload (%p:%p) overlaps another payload (%p:%p)\n",
                          lo, hi, p->lo, p->hi);
@@ -622,15 +913,16 @@ static int add_range(range_t **ranges, char *lo, int size,
 
     /*
      * Everything looks OK, so remember the extent of this block
-     * by creating a range struct and adding it the range list.
+     * by creating a range struct and adding it the range tree.
      */
     if ((p = (range_t *)malloc(sizeof(range_t))) == NULL)
         unix_error("malloc error in add_range");
-    p->next = *ranges;
+    p->left = p->right = NULL;
     p->lo = lo;
     p->hi = hi;
+    p->prio = (unsigned)(((unsigned long)lo * 0x9e3779b97f4a7c15UL) >> 32);
     p->index = index;
-    *ranges = p;
+    *ranges = range_insert(*ranges, p);
 
     return 1;
 }
@@ -643,13 +935,13 @@ static void remove_range(range_t **ranges, char *lo)
     range_t *p;
     range_t **prevpp = ranges;
 
-    for (p = *ranges;  p != NULL; p = p->next) {
+    for (p = *ranges;  p != NULL; p = *prevpp) {
         if (p->lo == lo) {
-            *prevpp = p->next;
+            *prevpp = range_join(p->left, p->right);
             free(p);
             break;
         }
-        prevpp = &(p->next);
+        prevpp = (lo < p->lo) ? &(p->left) : &(p->right);
     }
 }
 
@@ -658,16 +950,27 @@ static void remove_range(range_t **ranges, char *lo)
  */
 static void clear_ranges(range_t **ranges)
 {
-    range_t *p;
-    range_t *pnext;
+    range_t *p = *ranges;
 
-    for (p = *ranges;  p != NULL;  p = pnext) {
-        pnext = p->next;
-        free(p);
-    }
+    if (p == NULL)
+        return;
+    clear_ranges(&p->left);
+    clear_ranges(&p->right);
+    free(p);
     *ranges = NULL;
 }
 
+/*
+ * check_ranges - Check the data of every block in the range tree r
+ */
+static void check_ranges(const trace_t *trace, int opnum, const range_t *r)
+{
+    for (; r != NULL; r = r->right) {
+        check_ranges(trace, opnum, r->left);
+        check_index(trace, opnum, r->index);
+    }
+}
+
 /**********************************************
  * The following routines handle the random data used for
  * checking memory access.
@@ -735,7 +1038,56 @@ static void check_index(const trace_t *trace, int opnum, int index) {
  *********************************************/
 
 /*
- * read_trace - read a trace file and store it in memory
+ * map_trace - Map the compiled trace in file path and point the ops of
+ *     trace at its records. Returns 0, having mapped nothing, if path is
+ *     not a compiled trace.
+ */
+static int map_trace(trace_t *trace, const char *path)
+{
+    trace_hdr_t hdr;
+    struct stat st;
+    int fd, i;
+
+    if ((fd = open(path, O_RDONLY)) < 0)
+        return 0;
+    if (read(fd, &hdr, sizeof(hdr)) != sizeof(hdr) ||
+        memcmp(hdr.magic, TRACE_MAGIC, sizeof(hdr.magic)) != 0) {
+        close(fd);
+        return 0;
+    }
+    if (fstat(fd, &st) < 0 || hdr.num_ops < 0 || (size_t)st.st_size !=
+        sizeof(hdr) + (size_t)hdr.num_ops * sizeof(traceop_t))
+        app_error("%s: compiled trace is truncated or from another machine",
+                  path);
+
+    trace->map_len = st.st_size;
+    trace->map = mmap(NULL, trace->map_len, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (trace->map == MAP_FAILED)
+        unix_error("mmap of %s failed in read_trace", path);
+    trace->ops = (traceop_t *)((char *)trace->map + sizeof(hdr));
+    trace->weight = hdr.weight;
+    trace->num_ids = hdr.num_ids;
+    trace->num_ops = hdr.num_ops;
+    trace->ignore_ranges = hdr.ignore_ranges;
+
+    /* The file may not be tracebin's; check every request before the
+     * eval loops switch on its type and index the blocks with it */
+    for (i = 0; i < trace->num_ops; i++) {
+        if (trace->ops[i].type != ALLOC && trace->ops[i].type != FREE &&
+            trace->ops[i].type != REALLOC)
+            app_error("%s: bad type in request %d", path, i);
+        if (trace->ops[i].index >= trace->num_ids ||
+            trace->ops[i].index < (trace->ops[i].type == FREE ? -1 : 0))
+            app_error("%s: bad index in request %d", path, i);
+    }
+    return 1;
+}
+
+/*
+ * read_trace - read a trace file and store it in memory. A trace
+ *     compiled by tracebin, given directly or as <file>.bin no older
+ *     than <file>, is mapped instead of parsed.
  */
 static trace_t *read_trace(stats_t *stats, const char *tracedir,
                            const char *filename)
@@ -743,6 +1095,8 @@ static trace_t *read_trace(stats_t *stats, const char *tracedir,
     FILE *tracefile;
     trace_t *trace;
     char type[MAXLINE];
+    char binfile[MAXLINE + 4];
+    struct stat st, binst;
     int index, size;
     int max_index = 0;
     int op_index;
@@ -753,10 +1107,17 @@ static trace_t *read_trace(stats_t *stats, const char *tracedir,
     /* Allocate the trace record */
     if ((trace = (trace_t *) malloc(sizeof(trace_t))) == NULL)
         unix_error("malloc 1 failed in read_trace");
+    trace->map = NULL;
 
-    /* Read the trace file header */
     strcpy(trace->filename, tracedir);
     strcat(trace->filename, filename);
+    snprintf(binfile, sizeof(binfile), "%s.bin", trace->filename);
+    if ((stat(trace->filename, &st) == 0 && stat(binfile, &binst) == 0 &&
+         binst.st_mtime >= st.st_mtime && map_trace(trace, binfile)) ||
+        map_trace(trace, trace->filename))
+        goto loaded;
+
+    /* Read the trace file header */
     if ((tracefile = fopen(trace->filename, "r")) == NULL) {
         unix_error("Could not open %s in read_trace", trace->filename);
     }
@@ -765,34 +1126,11 @@ static trace_t *read_trace(stats_t *stats, const char *tracedir,
     fscanf(tracefile, "%d", &trace->num_ops);
     fscanf(tracefile, "%d", &trace->ignore_ranges);
 
-    if(trace->weight < 0 || trace->weight > 3) {
-        app_error("%s: weight can only be in {0, 1, 2 3}", trace->filename);
-    }
-    if(trace->ignore_ranges != 0 && trace->ignore_ranges != 1) {
-        app_error("%s: ignore-ranges can only be zero or one", trace->filename);
-    }
-
     /* We'll store each request line in the trace in this array */
     if ((trace->ops =
          (traceop_t *)malloc(trace->num_ops * sizeof(traceop_t))) == NULL)
         unix_error("malloc 2 failed in read_trace");
 
-    /* We'll keep an array of pointers to the allocated blocks here... */
-    if ((trace->blocks =
-         (char **)calloc(trace->num_ids, sizeof(char *))) == NULL)
-        unix_error("malloc 3 failed in read_trace");
-
-    /* ... along with the corresponding byte sizes of each block */
-    if ((trace->block_sizes =
-         (size_t *)calloc(trace->num_ids,  sizeof(size_t))) == NULL)
-        unix_error("malloc 4 failed in read_trace");
-
-    /* and, if we're debugging, the offset into the random data */
-    if ((trace->block_rand_base =
-         calloc(trace->num_ids, sizeof(*trace->block_rand_base))) == NULL)
-        unix_error("malloc 5 failed in read_trace");
-
-
     /* read every request line in the trace file */
     index = 0;
     op_index = 0;
@@ -828,6 +1166,29 @@ static trace_t *read_trace(stats_t *stats, const char *tracedir,
     assert(max_index == trace->num_ids - 1);
     assert(trace->num_ops == op_index);
 
+ loaded:
+    if(trace->weight < 0 || trace->weight > 3) {
+        app_error("%s: weight can only be in {0, 1, 2 3}", trace->filename);
+    }
+    if(trace->ignore_ranges != 0 && trace->ignore_ranges != 1) {
+        app_error("%s: ignore-ranges can only be zero or one", trace->filename);
+    }
+
+    /* We'll keep an array of pointers to the allocated blocks here... */
+    if ((trace->blocks =
+         (char **)calloc(trace->num_ids, sizeof(char *))) == NULL)
+        unix_error("malloc 3 failed in read_trace");
+
+    /* ... along with the corresponding byte sizes of each block */
+    if ((trace->block_sizes =
+         (size_t *)calloc(trace->num_ids,  sizeof(size_t))) == NULL)
+        unix_error("malloc 4 failed in read_trace");
+
+    /* and, if we're debugging, the offset into the random data */
+    if ((trace->block_rand_base =
+         calloc(trace->num_ids, sizeof(*trace->block_rand_base))) == NULL)
+        unix_error("malloc 5 failed in read_trace");
+
     /* fill in the stats */
     strcpy(stats->filename, trace->filename);
     stats->weight = trace->weight;
@@ -848,11 +1209,15 @@ static void reinit_trace(trace_t *trace)
 
 /*
  * free_trace - Free the trace record and the four arrays it points
- *              to, all of which were allocated in read_trace().
+ *              to, all of which were allocated in read_trace(), or
+ *              mapped from a compiled trace in the case of the ops.
  */
 static void free_trace(trace_t *trace)
 {
-    free(trace->ops);         /* free the three arrays... */
+    if (trace->map)           /* unmap the ops of a compiled trace... */
+        munmap(trace->map, trace->map_len);
+    else
+        free(trace->ops);     /* or free the four arrays... */
     free(trace->blocks);
     free(trace->block_sizes);
     free(trace->block_rand_base);
@@ -864,6 +1229,31 @@ static void free_trace(trace_t *trace)
  * and throughput of the libc and mm malloc packages.
  **********************************************************************/
 
+/*
+ * check_trace - Check the mm malloc package on trace tracenum for
+ *     correctness and, unless only correctness is checked (-c), for
+ *     space utilization, printing its statistics and writing its heap
+ *     layout if asked to. Returns whether the trace ran correctly.
+ */
+static int check_trace(trace_t *trace, stats_t *stats, int tracenum,
+                       range_t **ranges)
+{
+    if (verbose > 1)
+        printf("Checking mm_malloc for correctness, ");
+    stats->valid = eval_mm_valid(trace, ranges);
+    if (onetime_flag || !stats->valid)
+        return stats->valid;
+
+    if (verbose > 1)
+        printf("efficiency, ");
+    stats->util = eval_mm_util(trace, tracenum);
+    if (print_stats)
+        printmmstats(trace->filename);
+    if (heapdir)
+        dump_mm_heap(trace, tracenum);
+    return 1;
+}
+
 /*
  * eval_mm_valid - Check the mm malloc package for correctness
  */
@@ -893,17 +1283,11 @@ static int eval_mm_valid(trace_t *trace, range_t **ranges)
         size = trace->ops[i].size;
 
         if(debug_mode == DBG_EXPENSIVE) {
-            range_t *r;
-                        
             /* Let the students check their own heap */
             mm_checkheap(verbose);
 
             /* Now check that all our allocated blocks have the right data */
-            r = *ranges;
-            while(r) {
-                check_index(trace, i, r->index);
-                r = r->next;
-            }
+            check_ranges(trace, i, *ranges);
         }
 
         switch (trace->ops[i].type) {
@@ -1000,10 +1384,9 @@ static int eval_mm_valid(trace_t *trace, range_t **ranges)
  *   The idea is to remember the high water mark "hwm" of the heap for
  *   an optimal allocator, i.e., no gaps and no internal fragmentation.
  *   Utilization is the ratio hwm/heapsize, where heapsize is the
- *   size of the heap in bytes after running the student's malloc
- *   package on the trace. Note that our implementation of mem_sbrk()
- *   doesn't allow the students to decrement the brk pointer, so brk
- *   is always the high water mark of the heap.
+ *   largest size of the heap in bytes while running the student's
+ *   malloc package on the trace. The package may shrink the heap with
+ *   a negative mem_sbrk(), which does not lower this high water mark.
  *
  *   A higher number is better: 1 is optimal.
  */
@@ -1088,7 +1471,74 @@ static double eval_mm_util(trace_t *trace, int tracenum)
 
     printf(".");
 
-    return ((double)max_total_size / (double)mem_heapsize());
+    return ((double)max_total_size / (double)mem_peak_heapsize());
+}
+
+/*
+ * dump_mm_heap - Write the heap layout of the student's package, as
+ *   mm_heapdump() gives it, to the file <heapdir>/<trace>.heap. The
+ *   trace is run again up to the request after which the most payload
+ *   is allocated, where fragmentation costs the most.
+ */
+static void dump_mm_heap(trace_t *trace, int tracenum)
+{
+    int i, index, peak_op = -1;
+    long total_size = 0, max_total_size = 0;
+    char path[2*MAXLINE];
+    const char *name;
+    char *p;
+    FILE *fp;
+
+    /* Find the request at the high water mark of the payload */
+    reinit_trace(trace);
+    for (i = 0; i < trace->num_ops; i++) {
+        index = trace->ops[i].index;
+        if (index < 0)
+            continue;
+        total_size -= trace->block_sizes[index];
+        trace->block_sizes[index] =
+            (trace->ops[i].type == FREE) ? 0 : trace->ops[i].size;
+        total_size += trace->block_sizes[index];
+        if (total_size > max_total_size) {
+            max_total_size = total_size;
+            peak_op = i;
+        }
+    }
+
+    /* Run the trace up to there */
+    reinit_trace(trace);
+    mem_reset_brk();
+    if (mm_init() < 0)
+        app_error("trace %d: mm_init failed in dump_mm_heap", tracenum);
+    for (i = 0; i <= peak_op; i++) {
+        index = trace->ops[i].index;
+        switch (trace->ops[i].type) {
+        case ALLOC:
+            p = mm_malloc(trace->ops[i].size);
+            break;
+        case REALLOC:
+            p = mm_realloc(trace->blocks[index], trace->ops[i].size);
+            break;
+        default:
+            mm_free(index < 0 ? NULL : trace->blocks[index]);
+            p = NULL;
+        }
+        if (p == NULL && trace->ops[i].type != FREE) {
+            malloc_error(trace, i, "mm_%s failed in dump_mm_heap.",
+                         trace->ops[i].type == ALLOC ? "malloc" : "realloc");
+            return;
+        }
+        if (index >= 0)
+            trace->blocks[index] = p;
+    }
+
+    name = strrchr(trace->filename, '/');
+    name = name ? name + 1 : trace->filename;
+    sprintf(path, "%s/%s.heap", heapdir, name);
+    if ((fp = fopen(path, "w")) == NULL)
+        unix_error("dump_mm_heap: could not open %s", path);
+    mm_heapdump(fp);
+    fclose(fp);
 }
 
 
@@ -1144,6 +1594,91 @@ static void eval_mm_speed(void *ptr)
         }
 }
 
+/*
+ * lat_bucket - Return the histogram bucket of a latency of c cycles
+ */
+static int lat_bucket(unsigned long c)
+{
+    int e;
+
+    if (c < 4)
+        return c;
+    e = 63 - __builtin_clzl(c);
+    return e * 4 + ((c >> (e - 2)) & 3);
+}
+
+/*
+ * lat_low - Return the fewest cycles that fall in bucket b
+ */
+static unsigned long lat_low(int b)
+{
+    if (b < 8) /* Buckets 4 to 7 are not used */
+        return (b < 4) ? b : 4;
+    return (4UL + b % 4) << (b / 4 - 2);
+}
+
+/*
+ * eval_mm_latency - Run the trace once more, reading the cycle counter
+ *     around each request, and add up the latencies of each type of
+ *     request in stats. This is a pass of its own after the trace is
+ *     timed, so reading the counter does not slow the throughput down.
+ */
+static void eval_mm_latency(trace_t *trace, stats_t *stats)
+{
+    int i, index;
+    unsigned long c;
+    double t;
+    char *p;
+    lat_t *lat;
+
+    reinit_trace(trace);
+    memset(stats->lat, 0, sizeof(stats->lat));
+    mem_reset_brk();
+    if (mm_init() < 0)
+        app_error("mm_init failed in eval_mm_latency");
+
+    start_counter();
+    for (i = 0;  i < trace->num_ops;  i++) {
+        index = trace->ops[i].index;
+        switch (trace->ops[i].type) {
+
+        case ALLOC: /* mm_malloc */
+            t = get_counter();
+            p = mm_malloc(trace->ops[i].size);
+            c = get_counter() - t;
+            if (p == NULL)
+                app_error("mm_malloc error in eval_mm_latency");
+            trace->blocks[index] = p;
+            break;
+
+        case REALLOC: /* mm_realloc */
+            t = get_counter();
+            p = mm_realloc(trace->blocks[index], trace->ops[i].size);
+            c = get_counter() - t;
+            if (p == NULL && trace->ops[i].size != 0)
+                app_error("mm_realloc error in eval_mm_latency");
+            trace->blocks[index] = p;
+            break;
+
+        case FREE: /* mm_free */
+            p = (index < 0) ? NULL : trace->blocks[index];
+            t = get_counter();
+            mm_free(p);
+            c = get_counter() - t;
+            break;
+
+        default:
+            app_error("Nonexistent request type in eval_mm_latency");
+        }
+
+        lat = &stats->lat[trace->ops[i].type];
+        lat->count++;
+        lat->hist[lat_bucket(c)]++;
+        if (c > lat->max)
+            lat->max = c;
+    }
+}
+
 /*
  * eval_libc_valid - We run this function to make sure that the
  *    libc malloc can run to completion on the set of traces.
@@ -1241,6 +1776,234 @@ static void eval_libc_speed(void *ptr)
     }
 }
 
+/*
+ * replay_free - Free block p with the allocator thread r replays against
+ */
+static void replay_free(const replay_t *r, void *p)
+{
+    if (r->libc)
+        free(p);
+    else
+        mm_free(p);
+}
+
+/*
+ * replay_take - Free the blocks the thread before r handed off since it
+ *     last looked, the first taken of them; return how many it has freed
+ */
+static int replay_take(replay_t *r, int taken)
+{
+    int n = __atomic_load_n(&r->from->nout, __ATOMIC_ACQUIRE);
+
+    for (; taken < n; taken++)
+        replay_free(r, r->from->out[taken]);
+    return taken;
+}
+
+/*
+ * replay_thread - Replay the trace in one thread of eval_threads. With
+ *     handoff, blocks are passed to the next thread to free in batches
+ *     of REPLAY_BATCH, and the thread frees those of the thread before it
+ *     as it goes and when it is done
+ */
+static void *replay_thread(void *ptr)
+{
+    replay_t *r = ptr;
+    trace_t *trace = r->trace;
+    int i, index, size, nout = 0, taken = 0;
+    char *p;
+
+    pthread_barrier_wait(r->start);
+    for (i = 0; i < trace->num_ops; i++) {
+        index = trace->ops[i].index;
+        size = trace->ops[i].size;
+        switch (trace->ops[i].type) {
+        case ALLOC:
+            p = r->libc ? malloc(size) : mm_malloc(size);
+            if (p == NULL)
+                r->failed = 1;
+            r->blocks[index] = p;
+            break;
+
+        case REALLOC:
+            p = r->libc ? realloc(r->blocks[index], size) :
+                mm_realloc(r->blocks[index], size);
+            if (p == NULL && size != 0)
+                r->failed = 1;
+            r->blocks[index] = p;
+            break;
+
+        case FREE:
+            p = (index < 0) ? NULL : r->blocks[index];
+            if (index >= 0)
+                r->blocks[index] = NULL;
+            if (!r->handoff || p == NULL) {
+                replay_free(r, p);
+                break;
+            }
+            r->out[nout++] = p;
+            if (nout % REPLAY_BATCH == 0) {
+                __atomic_store_n(&r->nout, nout, __ATOMIC_RELEASE);
+                taken = replay_take(r, taken);
+            }
+            break;
+
+        default:
+            app_error("Nonexistent request type in replay_thread");
+        }
+        if (r->failed) /* The heap is full; the run does not count */
+            break;
+    }
+    if (!r->handoff)
+        return NULL;
+
+    /* Hand off the rest, then free the rest of the thread before */
+    __atomic_store_n(&r->nout, nout, __ATOMIC_RELEASE);
+    __atomic_store_n(&r->done, 1, __ATOMIC_RELEASE);
+    while (!__atomic_load_n(&r->from->done, __ATOMIC_ACQUIRE)) {
+        taken = replay_take(r, taken);
+        sched_yield();
+    }
+    replay_take(r, taken);
+    return NULL;
+}
+
+/*
+ * eval_threads - Replay the trace in nthreads threads at once with mm
+ *     or libc malloc; the function that ftimer_gettod times for -T.
+ *     Blocks the trace leaves allocated are freed after the threads end
+ */
+static void eval_threads(void *ptr)
+{
+    threads_t *t = ptr;
+    replay_t *r = t->threads;
+    pthread_t tid[t->nthreads];
+    pthread_barrier_t start;
+    int i, j;
+
+    if (!t->libc) {
+        mem_reset_brk();
+        if (mm_init() < 0)
+            app_error("mm_init failed in eval_threads");
+    }
+    pthread_barrier_init(&start, NULL, t->nthreads + 1);
+    for (i = 0; i < t->nthreads; i++) {
+        r[i].trace = t->trace;
+        r[i].start = &start;
+        r[i].from = &r[(i + t->nthreads - 1) % t->nthreads];
+        r[i].libc = t->libc;
+        r[i].handoff = t->handoff;
+        r[i].nout = 0;
+        r[i].done = 0;
+        r[i].failed = 0;
+        memset(r[i].blocks, 0, t->trace->num_ids * sizeof(char *));
+        if (pthread_create(&tid[i], NULL, replay_thread, &r[i]) != 0)
+            unix_error("pthread_create failed in eval_threads");
+    }
+    pthread_barrier_wait(&start);
+    for (i = 0; i < t->nthreads; i++)
+        pthread_join(tid[i], NULL);
+    pthread_barrier_destroy(&start);
+
+    for (i = 0; i < t->nthreads; i++) {
+        t->failed |= r[i].failed;
+        if (t->libc)
+            for (j = 0; j < t->trace->num_ids; j++)
+                free(r[i].blocks[j]);
+    }
+}
+
+/*
+ * run_threads - Replay each valid trace in 1 up to max_threads threads,
+ *     first each thread freeing its own blocks, then each handing them
+ *     to the next to free, with mm and, if run_libc is set, with libc
+ *     malloc. Prints the throughput of all the traces together for
+ *     each thread count
+ */
+static void run_threads(int num_tracefiles, const char *tracedir,
+                        char **tracefiles, stats_t *mm_stats, int run_libc)
+{
+    static const char *modes[2] = { "own frees", "frees handed off" };
+    double secs[2][2][max_threads + 1], ops[max_threads + 1];
+    int failed[2][2][max_threads + 1];
+    replay_t r[max_threads];
+    threads_t t;
+    stats_t stats;
+    int i, n, mode, libc, nfrees;
+
+    memset(secs, 0, sizeof(secs));
+    memset(ops, 0, sizeof(ops));
+    memset(failed, 0, sizeof(failed));
+    for (i = 0; i < num_tracefiles; i++) {
+        if (!mm_stats[i].valid)
+            continue;
+        mem_init();
+        t.trace = read_trace(&stats, tracedir, tracefiles[i]);
+        for (n = 0, nfrees = 0; n < t.trace->num_ops; n++)
+            nfrees += (t.trace->ops[n].type == FREE);
+        for (n = 0; n < max_threads; n++) {
+            r[n].blocks = calloc(t.trace->num_ids, sizeof(char *));
+            r[n].out = malloc((nfrees + 1) * sizeof(char *));
+            if (r[n].blocks == NULL || r[n].out == NULL)
+                unix_error("malloc failed in run_threads");
+        }
+        if (verbose > 1)
+            printf("Replaying %s in threads\n", t.trace->filename);
+
+        t.threads = r;
+        for (n = 1; n <= max_threads; n++) {
+            ops[n] += (double)n * t.trace->num_ops;
+            for (mode = 0; mode < 2; mode++)
+                for (libc = 0; libc <= run_libc; libc++) {
+                    t.nthreads = n;
+                    t.handoff = mode;
+                    t.libc = libc;
+                    t.failed = 0;
+                    secs[mode][libc][n] += ftimer_gettod(eval_threads, &t,
+                                                         REPLAY_REPS);
+                    failed[mode][libc][n] |= t.failed;
+                    if (t.failed)
+                        printf("%s: %s malloc ran out of memory in %d "
+                               "threads\n", t.trace->filename,
+                               libc ? "libc" : "mm", n);
+                }
+        }
+
+        for (n = 0; n < max_threads; n++) {
+            free(r[n].blocks);
+            free(r[n].out);
+        }
+        free_trace(t.trace);
+        mem_deinit();
+    }
+
+    for (mode = 0; mode < 2; mode++) {
+        printf("Threaded replay, %s (Kops, and speedup over 1 thread):\n",
+               modes[mode]);
+        printf("  %7s %10s %7s", "threads", "mm", "");
+        if (run_libc)
+            printf(" %10s %7s %8s", "libc", "", "mm/libc");
+        printf("\n");
+        for (n = 1; n <= max_threads; n++) {
+            printf("  %7d", n);
+            for (libc = 0; libc <= run_libc; libc++) {
+                if (failed[mode][libc][n] || secs[mode][libc][n] == 0)
+                    printf(" %10s %7s", "-", "-");
+                else
+                    printf(" %10.0f %6.2fx",
+                           ops[n] / secs[mode][libc][n] / 1e3,
+                           (ops[n] / secs[mode][libc][n]) /
+                           (ops[1] / secs[mode][libc][1]));
+            }
+            if (run_libc && !failed[mode][0][n] && !failed[mode][1][n] &&
+                secs[mode][0][n] > 0)
+                printf(" %8.2f", secs[mode][1][n] / secs[mode][0][n]);
+            printf("\n");
+        }
+        printf("\n");
+    }
+}
+
 /*************************************
  * Some miscellaneous helper routines
  ************************************/
@@ -1412,21 +2175,111 @@ void malloc_error(const trace_t *trace, int opnum, const char *fmt, ...)
     va_end(ap);
 }
 
+/*
+ * lat_percentile - Return the most cycles that the fraction q of the
+ *     requests in lat took, to within a histogram bucket
+ */
+static unsigned long lat_percentile(const lat_t *lat, double q)
+{
+    unsigned long seen = 0;
+    int b;
+
+    for (b = 0; b < LAT_BUCKETS - 1; b++) {
+        seen += lat->hist[b];
+        if (seen >= q * lat->count)
+            break;
+    }
+    return (lat_low(b + 1) - 1 < lat->max) ? lat_low(b + 1) - 1 : lat->max;
+}
+
+/*
+ * printlatency - Print the latency percentiles of each type of request
+ *     of each valid trace, then those of all the traces together
+ */
+static void printlatency(int n, stats_t *stats)
+{
+    static const char *names[3] = { "malloc", "free", "realloc" };
+    lat_t all[3];
+    int i, t, b;
+
+    printf("Request latencies in cycles (counter overhead %.0f):\n", ovhd());
+    printf("  %-7s %8s %7s %7s %7s %9s  %s\n",
+           "request", "count", "p50", "p99", "p99.9", "max", "trace");
+    memset(all, 0, sizeof(all));
+    for (i = 0; i <= n; i++) {
+        if (i < n && !stats[i].valid)
+            continue;
+        for (t = 0; t < 3; t++) {
+            const lat_t *lat = (i < n) ? &stats[i].lat[t] : &all[t];
+
+            if (lat->count == 0)
+                continue;
+            printf("  %-7s %8lu %7lu %7lu %7lu %9lu  %s\n", names[t],
+                   lat->count, lat_percentile(lat, 0.5),
+                   lat_percentile(lat, 0.99), lat_percentile(lat, 0.999),
+                   lat->max, (i < n) ? stats[i].filename : "all traces");
+            if (i == n)
+                continue;
+            all[t].count += lat->count;
+            if (lat->max > all[t].max)
+                all[t].max = lat->max;
+            for (b = 0; b < LAT_BUCKETS; b++)
+                all[t].hist[b] += lat->hist[b];
+        }
+    }
+    printf("\n");
+}
+
+/*
+ * printmmstats - prints the statistics of the mm package after it ran
+ *                the trace in filename
+ */
+static void printmmstats(const char *filename)
+{
+    struct mm_stats st;
+    int i;
+
+    mm_getstats(&st);
+    printf("\nAllocator statistics for %s:\n", filename);
+    printf("heap %zu bytes, peak %zu bytes\n", st.heap_size, st.peak_heap);
+    printf("%zu mallocs, %zu frees, %zu splits, %zu coalesces\n",
+           st.mallocs, st.frees, st.splits, st.coalesces);
+    printf("requested %zu bytes, granted %zu bytes (%.1f%% internal)\n",
+           st.requested, st.granted, st.granted ?
+           100.0 * (st.granted - st.requested) / st.granted : 0.0);
+    printf("fit searches by blocks seen: 0:%zu 1:%zu", st.search[0], st.search[1]);
+    for (i = 2; i < MM_STATS_SEARCH - 1; i++)
+        printf(" %d-%d:%zu", 1 << (i - 1), (1 << i) - 1, st.search[i]);
+    printf(" %d+:%zu", 1 << (i - 1), st.search[i]);
+    printf("\n%zu allocated blocks of %zu bytes\n",
+           st.alloc_count, st.alloc_bytes);
+    printf("%8s %8s %10s  free blocks by class\n", "size", "count", "bytes");
+    for (i = 0; i < MM_STATS_CLASSES; i++)
+        if (st.free_count[i])
+            printf("%8zu %8zu %10zu\n",
+                   st.class_size[i], st.free_count[i], st.free_bytes[i]);
+}
+
 /*
  * usage - Explain the command line arguments
  */
 static void usage(void)
 {
-    fprintf(stderr, "Usage: mdriver [-hlVdD] [-f <file>]\n");
+    fprintf(stderr, "Usage: mdriver [-hlVdDLS] [-j <n>] [-T <n>] [-H <dir>] [-f <file>]\n");
     fprintf(stderr, "Options\n");
     fprintf(stderr, "\t-d <i>     Debug: 0 off; 1 default; 2 lots.\n");
     fprintf(stderr, "\t-D         Equivalent to -d2.\n");
     fprintf(stderr, "\t-c <file>  Run trace file <file> once, check for correctness only.\n");
     fprintf(stderr, "\t-t <dir>   Directory to find default traces.\n");
     fprintf(stderr, "\t-h         Print this message.\n");
+    fprintf(stderr, "\t-j <n>     Check traces in <n> processes (0: one per CPU).\n");
     fprintf(stderr, "\t-l         Run libc malloc as well.\n");
+    fprintf(stderr, "\t-L         Print latency percentiles of each request type.\n");
+    fprintf(stderr, "\t-T <n>     Replay the traces in 1 to <n> threads (needs -DARENAS).\n");
     fprintf(stderr, "\t-V         Print diagnostics as each trace is run.\n");
     fprintf(stderr, "\t-v <i>     Set Verbosity Level to <i>\n");
     fprintf(stderr, "\t-s <s>     Timeout after s secs (default no timeout)\n");
+    fprintf(stderr, "\t-S         Print allocator statistics after each trace.\n");
+    fprintf(stderr, "\t-H <dir>   Write the heap at each trace's peak to <dir>/<trace>.heap.\n");
     fprintf(stderr, "\t-f <file>  Use <file> as the trace file.\n");
 }
@@ -5,6 +5,7 @@
  */
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <assert.h>
 #include <unistd.h>
 #include <sys/mman.h>
@@ -16,10 +17,28 @@
 #include "memlib.h"
 #include "config.h"
 
+/* A region mapped by mem_map starts with this record, which links it
+ * in the list of mapped regions. MAP_REC is its size, kept 16-byte
+ * aligned so the caller's part of the region is too */
+struct mem_region {
+	struct mem_region *next, *prev;
+	size_t len;						/* length of the mapping */
+};
+#define MAP_REC 32
+
 /* private variables */
 static char *heap;
 static char *mem_brk;
 static char *mem_max_addr;
+static struct mem_region *mem_regions;	/* regions made by mem_map */
+static size_t mem_mapped;			/* bytes in mapped regions */
+static size_t mem_peak_size;		/* largest heapsize since the last reset */
+
+/* mem_note_size - remember the heap size if it is the largest yet */
+static void mem_note_size(void) {
+	if (mem_heapsize() > mem_peak_size)
+		mem_peak_size = mem_heapsize();
+}
 
 /* 
  * mem_init - initialize the memory system model
@@ -34,6 +53,7 @@ void mem_init(void){
 			0);						/* offset (dunno) */
 	mem_max_addr = heap + MAX_HEAP;
 	mem_brk = heap;					/* heap is empty initially */
+	mem_peak_size = 0;
 }
 
 /* 
@@ -45,21 +65,38 @@ void mem_deinit(void){
 
 /*
  * mem_reset_brk - reset the simulated brk pointer to make an empty heap
+ *		and unmap every mapped region
  */
 void mem_reset_brk(){
+	while (mem_regions != NULL)
+		mem_unmap((char *)mem_regions + MAP_REC);
 	mem_brk = heap;
+	mem_peak_size = 0;
 }
 
 /* 
  * mem_sbrk - simple model of the sbrk function. Extends the heap 
- *		by incr bytes and returns the start address of the new area. In
- *		this model, the heap cannot be shrunk.
+ *		by incr bytes and returns the start address of the new area. A
+ *		negative incr shrinks the heap and releases the pages above the
+ *		new brk.
  */
 void *mem_sbrk(int incr) {
 	char *old_brk = mem_brk;
 
+	if (incr < 0) {
+		if (mem_brk + incr < heap) {
+			errno = EINVAL;
+			fprintf(stderr, "ERROR: mem_sbrk failed. Shrunk below the heap...\n");
+			return (void *)-1;
+		}
+		/* Not passed on to sbrk(), whose top may now be libc's heap */
+		mem_brk += incr;
+		mem_release(mem_brk, -incr);
+		return (void *)old_brk;
+	}
+
     // call sbrk() in an attempt to have similar semantics as a real allocator.
-	if ( (incr < 0) || ((mem_brk + incr) > mem_max_addr) ||
+	if (((mem_brk + incr) > mem_max_addr) ||
             sbrk(incr) == (void *) -1) {
 		errno = ENOMEM;
 		fprintf(stderr, "ERROR: mem_sbrk failed. Ran out of memory...\n");
@@ -67,9 +104,88 @@ void *mem_sbrk(int incr) {
 	}
 
 	mem_brk += incr;
+	mem_note_size();
 	return (void *)old_brk;
 }
 
+/*
+ * mem_map - map a region of len bytes of its own, outside the heap,
+ *		like mmap(). Returns its start, 16-byte aligned, or NULL if it
+ *		can not be mapped. The region counts in the heap size until it
+ *		is given to mem_unmap
+ */
+void *mem_map(size_t len) {
+	size_t pagesize = mem_pagesize();
+	struct mem_region *r;
+
+	if (len > SIZE_MAX - MAP_REC - pagesize) {	/* would wrap around */
+		errno = ENOMEM;
+		fprintf(stderr, "ERROR: mem_map failed. Ran out of memory...\n");
+		return NULL;
+	}
+	len = (len + MAP_REC + pagesize - 1) & ~(pagesize - 1);
+	r = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+			-1, 0);
+	if (r == MAP_FAILED) {
+		fprintf(stderr, "ERROR: mem_map failed. Ran out of memory...\n");
+		return NULL;
+	}
+	r->len = len;
+	r->prev = NULL;
+	r->next = mem_regions;
+	if (mem_regions != NULL)
+		mem_regions->prev = r;
+	mem_regions = r;
+	mem_mapped += len;
+	mem_note_size();
+	return (char *)r + MAP_REC;
+}
+
+/*
+ * mem_unmap - unmap region p made by mem_map
+ */
+void mem_unmap(void *p) {
+	struct mem_region *r = (struct mem_region *)((char *)p - MAP_REC);
+
+	if (r->prev != NULL)
+		r->prev->next = r->next;
+	else
+		mem_regions = r->next;
+	if (r->next != NULL)
+		r->next->prev = r->prev;
+	mem_mapped -= r->len;
+	munmap(r, r->len);
+}
+
+/*
+ * mem_is_heap - return whether the bytes lo to hi all lie in the heap
+ *		or all in one mapped region
+ */
+int mem_is_heap(void *lo, void *hi) {
+	struct mem_region *r;
+
+	if ((char *)lo >= heap && (char *)hi < mem_brk)
+		return 1;
+	for (r = mem_regions; r != NULL; r = r->next)
+		if ((char *)lo >= (char *)r + MAP_REC && (char *)hi < (char *)r + r->len)
+			return 1;
+	return 0;
+}
+
+/*
+ * mem_release - give the whole pages in the len bytes at p back to the
+ *		system, like madvise(MADV_DONTNEED). They read as zero when next
+ *		touched. p need not be in the heap
+ */
+void mem_release(void *p, size_t len) {
+	size_t pagesize = mem_pagesize();
+	char *lo = (char *)(((size_t)p + pagesize - 1) & ~(pagesize - 1));
+	char *hi = (char *)(((size_t)p + len) & ~(pagesize - 1));
+
+	if (hi > lo)
+		madvise(lo, hi - lo, MADV_DONTNEED);
+}
+
 /*
  * mem_heap_lo - return address of the first heap byte
  */
@@ -85,10 +201,19 @@ void *mem_heap_hi(){
 }
 
 /*
- * mem_heapsize() - returns the heap size in bytes
+ * mem_heapsize() - returns the heap size in bytes, mapped regions
+ *		included
  */
 size_t mem_heapsize() {
-	return (size_t)((void *)mem_brk - (void *)heap);
+	return (size_t)((void *)mem_brk - (void *)heap) + mem_mapped;
+}
+
+/*
+ * mem_peak_heapsize() - returns the largest heap size in bytes since
+ *		the heap was last reset
+ */
+size_t mem_peak_heapsize() {
+	return mem_peak_size;
 }
 
 /*
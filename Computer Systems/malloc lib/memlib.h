@@ -3,9 +3,14 @@
 void mem_init(void);               
 void mem_deinit(void);
 void *mem_sbrk(int incr);
+void mem_release(void *p, size_t len);
+void *mem_map(size_t len);
+void mem_unmap(void *p);
+int mem_is_heap(void *lo, void *hi);
 void mem_reset_brk(void); 
 void *mem_heap_lo(void);
 void *mem_heap_hi(void);
 size_t mem_heapsize(void);
+size_t mem_peak_heapsize(void);
 size_t mem_pagesize(void);
 
@@ -0,0 +1,195 @@
+/*
+ * memsys.c - the memory system of memlib.h on the real one, for mm.c
+ *		built as a shared library (libmm.so) instead of against the
+ *		model in memlib.c.
+ *
+ * The heap is the process's own, grown with sbrk(). It must stay in one
+ * piece, so once something else moves the break mem_sbrk fails, and the
+ * requests of arena 0 that its heap can not serve get mapped blocks of
+ * their own. mm.c keeps the heap within ARENA_SIZE itself. Regions of
+ * mem_map come straight from mmap(). mm.c calls these under its memory
+ * lock.
+ */
+#include <stdint.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/mman.h>
+
+#include "memlib.h"
+#include "config.h"
+
+/* A region mapped by mem_map starts with this record; MAP_REC is its
+ * size, kept 16-byte aligned so the caller's part of the region is too */
+struct mem_region {
+	size_t len;						/* length of the mapping */
+};
+#define MAP_REC 16
+
+/* private variables */
+static char *heap;					/* first heap byte, NULL until used */
+static char *mem_brk;
+static size_t mem_mapped;			/* bytes in mapped regions */
+static size_t mem_peak_size;		/* largest heapsize so far */
+
+/* mem_note_size - remember the heap size if it is the largest yet */
+static void mem_note_size(void) {
+	if (mem_heapsize() > mem_peak_size)
+		mem_peak_size = mem_heapsize();
+}
+
+/*
+ * mem_init - start the heap at the break, moved up to 16-byte alignment
+ */
+void mem_init(void){
+	char *brk = sbrk(0);
+	size_t pad = -(uintptr_t)brk & 15;
+
+	if (brk == (void *)-1 || (pad && sbrk(pad) == (void *)-1))
+		return;
+	heap = mem_brk = brk + pad;
+	mem_peak_size = 0;
+}
+
+/*
+ * mem_deinit - nothing to do; the heap goes with the process
+ */
+void mem_deinit(void){
+}
+
+/*
+ * mem_reset_brk - not supported on the real heap, whose blocks the
+ *		program may still use
+ */
+void mem_reset_brk(){
+}
+
+/*
+ * mem_sbrk - extend the heap by incr bytes with sbrk() and return the
+ *		start address of the new area. A negative incr shrinks the heap,
+ *		giving the pages back with sbrk() if the break is still the
+ *		heap's end
+ */
+void *mem_sbrk(int incr) {
+	char *old_brk;
+
+	if (heap == NULL)
+		mem_init();
+	if (heap == NULL)
+		return (void *)-1;
+	old_brk = mem_brk;
+
+	if (incr < 0) {
+		if (mem_brk + incr < heap) {
+			errno = EINVAL;
+			return (void *)-1;
+		}
+		mem_brk += incr;
+		if (sbrk(0) != old_brk || sbrk(incr) == (void *)-1)
+			mem_release(mem_brk, -incr);
+		return (void *)old_brk;
+	}
+
+	/* Grow only where the heap ends */
+	if (sbrk(0) != old_brk || sbrk(incr) == (void *)-1) {
+		errno = ENOMEM;
+		return (void *)-1;
+	}
+	mem_brk += incr;
+	mem_note_size();
+	return (void *)old_brk;
+}
+
+/*
+ * mem_map - map a region of len bytes of its own with mmap(). Returns
+ *		its start, 16-byte aligned, or NULL if it can not be mapped
+ */
+void *mem_map(size_t len) {
+	size_t pagesize = mem_pagesize();
+	struct mem_region *r;
+
+	if (len > SIZE_MAX - MAP_REC - pagesize) {	/* would wrap around */
+		errno = ENOMEM;
+		return NULL;
+	}
+	len = (len + MAP_REC + pagesize - 1) & ~(pagesize - 1);
+	r = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+			-1, 0);
+	if (r == MAP_FAILED)
+		return NULL;
+	r->len = len;
+	mem_mapped += len;
+	mem_note_size();
+	return (char *)r + MAP_REC;
+}
+
+/*
+ * mem_unmap - unmap region p made by mem_map
+ */
+void mem_unmap(void *p) {
+	struct mem_region *r = (struct mem_region *)((char *)p - MAP_REC);
+
+	mem_mapped -= r->len;
+	munmap(r, r->len);
+}
+
+/*
+ * mem_is_heap - return whether the bytes lo to hi all lie in the heap.
+ *		Mapped regions are not tracked here
+ */
+int mem_is_heap(void *lo, void *hi) {
+	return (char *)lo >= heap && (char *)hi < mem_brk;
+}
+
+/*
+ * mem_release - give the whole pages in the len bytes at p back to the
+ *		system with madvise(MADV_DONTNEED). They read as zero when next
+ *		touched. p need not be in the heap
+ */
+void mem_release(void *p, size_t len) {
+	size_t pagesize = mem_pagesize();
+	char *lo = (char *)(((size_t)p + pagesize - 1) & ~(pagesize - 1));
+	char *hi = (char *)(((size_t)p + len) & ~(pagesize - 1));
+
+	if (hi > lo)
+		madvise(lo, hi - lo, MADV_DONTNEED);
+}
+
+/*
+ * mem_heap_lo - return address of the first heap byte
+ */
+void *mem_heap_lo(){
+	if (heap == NULL)
+		mem_init();
+	return (void *)heap;
+}
+
+/*
+ * mem_heap_hi - return address of last heap byte
+ */
+void *mem_heap_hi(){
+	if (heap == NULL)
+		mem_init();
+	return (void *)(mem_brk - 1);
+}
+
+/*
+ * mem_heapsize() - returns the heap size in bytes, mapped regions
+ *		included
+ */
+size_t mem_heapsize() {
+	return (size_t)(mem_brk - heap) + mem_mapped;
+}
+
+/*
+ * mem_peak_heapsize() - returns the largest heap size in bytes so far
+ */
+size_t mem_peak_heapsize() {
+	return mem_peak_size;
+}
+
+/*
+ * mem_pagesize() - returns the page size of the system
+ */
+size_t mem_pagesize(){
+	return (size_t)getpagesize();
+}
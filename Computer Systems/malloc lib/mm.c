@@ -1,14 +1,20 @@
 /* Name - Vrushali Bhutada
  * Andrew ID - vbhutada
  * This is a 64-bit clean allocator based on segregated free lists,
- * first-fit placement, and boundary tag coalescing.
- * Each block is aligned to doubleword (8 byte) boundaries.
- * Minimum block size is 24 bytes. Each free block contains a pointer
- * to next and previous free block in its list. The header pointers of
- * each list are placed in the prolouge block. There are 13 free lists
- * in this emplementation.
+ * placement chosen by FIT_POLICY, and boundary tag coalescing.
+ * Each payload is aligned to ALIGNMENT (8 or 16) bytes.
+ * Minimum block size is 16 bytes. Only free blocks carry a footer; the
+ * PREV_ALLOC bit of each header tells whether the block before it is
+ * allocated. Each free block contains the next and previous free block
+ * in its list, stored as 32-bit offsets from the start of the heap.
+ * The header pointers of each list are placed in the prolouge block;
+ * the last one is the root of a red-black tree of the large free blocks.
+ * Small requests are served from slabs and huge ones from regions of
+ * their own; threaded builds keep a heap per arena. The build options
+ * are described with their constants below and in README.
  * In the program the pointers are pointing to the header of each block
- * This design does not have an epilogue block
+ * The epilogue header at the end of the heap holds the PREV_ALLOC bit of
+ * the last block
  * There is a list end marker with value 0/1 placed right after the prologue
  * it is pointed to by last node of every list
  */
@@ -16,11 +22,19 @@
 #include <string.h>
 #include <stdlib.h>
 #include <assert.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdint.h>
 #include <unistd.h>
+#if ARENAS
+#include <pthread.h>
+#include <sys/mman.h>
+#endif
 #include "contracts.h"
 
 #include "mm.h"
 #include "memlib.h"
+#include "config.h"
 
 /* If you want debugging output, use the following macro.  When you hand
  *  * in, remove the #define DEBUG line. */
@@ -38,13 +52,25 @@
 #define free mm_free
 #define realloc mm_realloc
 #define calloc mm_calloc
+#define memalign mm_memalign
+#define posix_memalign mm_posix_memalign
+#define aligned_alloc mm_aligned_alloc
+#define valloc mm_valloc
+#define pvalloc mm_pvalloc
+#define malloc_usable_size mm_malloc_usable_size
 #endif /* def DRIVER */
 
-/* single word (4) or double word (8) alignment */
+/* Payload alignment: double word (8), or 16 as libc gives with
+ * -DALIGNMENT=16. Block sizes are multiples of it */
+#ifndef ALIGNMENT
 #define ALIGNMENT 8
+#endif
+#if ALIGNMENT != 8 && ALIGNMENT != 16
+#error "ALIGNMENT must be 8 or 16"
+#endif
 
 /* rounds up to the nearest multiple of ALIGNMENT */
-#define ALIGN(p) (((size_t)(p) + (ALIGNMENT-1)) & ~0x7)
+#define ALIGN(p) (((size_t)(p) + (ALIGNMENT-1)) & ~(size_t)(ALIGNMENT-1))
 
 /* Macro to mm_checkheap */
 #define checkheap(lineno) //mm_checkheap(lineno)
@@ -55,20 +81,34 @@
 #define CHUNKSIZE  (1<<8)  /* Extend heap by this amount (bytes) */  
 
 #define MAX(x, y) ((x) > (y)? (x) : (y))  
+#define MIN(x, y) ((x) < (y)? (x) : (y))
 
-/* Pack a size and allocated bit into a word */
+/* Pack a size and allocated bits into a word */
 #define PACK(size, alloc)  ((size) | (alloc)) 
 
+/* Header bit set when the previous block is allocated */
+#define PREV_ALLOC 0x2
+
+/* Header bit set on an allocated block holding realloc headroom */
+#define GROWN 0x4
+
+/* Footer bit set on a free block whose inner pages were released */
+#define RELEASED 0x2
+
 /* Read and write a word at address p */
 #define GET(p)       (*(unsigned int *)(p))            
 #define PUT(p, val)  (*(unsigned int *)(p) = (val))    
 
-/* Read and write the pointer value stored in p */
-#define GETDL(p)      (*(char* *)(p))
-#define PUTDL(p, val) (*(char* *)(p) = (val))
+/* Read and write the pointer value stored in p as a heap offset */
+#define GETDL(p)      (heap_listp + GET(p))
+#define PUTDL(p, val) PUT(p, (unsigned int)((char *)(val) - heap_listp))
+
+/* Same for tree links, which may be NULL - stored as offset 0 */
+#define GETTL(p)      (GET(p) ? heap_listp + GET(p) : NULL)
+#define PUTTL(p, val) PUT(p, (val) ? (unsigned int)((char *)(val) - heap_listp) : 0)
 
 /*Given block ptr bp,compute address of pointers to next and prev free block*/
-#define PREV_FBLK_PTR(bp) ((char *)(((char *)(bp) + (3 * WSIZE))))
+#define PREV_FBLK_PTR(bp) ((char *)(((char *)(bp) + (2 * WSIZE))))
 #define NEXT_FBLK_PTR(bp) ((char *)((char *)(bp) + (WSIZE)))
 
 /*Given block ptr bp,compute the address of previous and next free block*/
@@ -78,39 +118,394 @@
 /* Read the size and allocated fields from address p */
 #define GET_SIZE(p)  (GET(p) & ~0x7)                   
 #define GET_ALLOC(p) (GET(p) & 0x1)                    
+#define GET_PREV_ALLOC(p) (GET(p) & PREV_ALLOC)
+#define GET_GROWN(p) (GET(p) & GROWN)
+
+/* Read and write header p of an allocated block. free reads it without
+ * the arena lock, while other threads may change its PREV_ALLOC or
+ * GROWN bits or cut its headroom off under the lock */
+#define GET_SHARED(p)      __atomic_load_n((unsigned int *)(p), __ATOMIC_RELAXED)
+#define PUT_SHARED(p, val) __atomic_store_n((unsigned int *)(p), (val), \
+                                            __ATOMIC_RELAXED)
+
+/* Set or clear the previous block allocated bit of header p */
+#define SET_PREV_ALLOC(p)   PUT_SHARED(p, GET(p) | PREV_ALLOC)
+#define CLEAR_PREV_ALLOC(p) PUT_SHARED(p, GET(p) & ~PREV_ALLOC)
+
+/* Set or clear the headroom bit of header p */
+#define SET_GROWN(p)   PUT_SHARED(p, GET(p) | GROWN)
+#define CLEAR_GROWN(p) PUT_SHARED(p, GET(p) & ~GROWN)
 
 /* Given block ptr bp, compute address of its header and footer */
 #define HDRP(bp) ((char *)(bp))                      
-#define FTRP(bp) ((char *)(bp) + GET_SIZE(bp) - WSIZE)
+#define FTRP(bp) ((char *)(bp) + GET_SIZE(bp) - WSIZE) /* Free blocks only */
 
-/* Given block ptr bp, compute address of next and previous blocks */
+/* Given block ptr bp, compute address of next and previous blocks
+ * PREV_BLKP is only valid when the previous block is free */
 #define NEXT_BLKP(bp)  ((char *)(bp) + GET_SIZE((char *)(bp)))
 #define PREV_BLKP(bp)  ((char *)(bp) - GET_SIZE(((char *)(bp) - WSIZE)))
 
-/* Macros to define the bucket size of segregated fee list */
-#define BKT1 249
-#define BKT2 1025
-#define BKT3 2609
-#define BKT4 3609
-#define BKT5 4609
-#define BKT6 5609
-#define BKT7 6609 
-#define BKT8 7609
-#define BKT9 8609
-#define BKT10 9609
-#define BKT11 10609
-#define BKT12 11609
+/* Placement policy, chosen at build time with -DFIT_POLICY=<policy>:
+ * FIRST_FIT takes the first fitting block of a list, BOUNDED_BEST_FIT
+ * takes the smallest of the first FIT_CANDIDATES fitting blocks and
+ * BEST_FIT keeps every list sorted by size so the first fit is the best */
+#define FIRST_FIT        0
+#define BOUNDED_BEST_FIT 1
+#define BEST_FIT         2
+#ifndef FIT_POLICY
+#define FIT_POLICY BOUNDED_BEST_FIT
+#endif
+#ifndef FIT_CANDIDATES
+#define FIT_CANDIDATES 8
+#endif
+
+/* Order of the free lists, chosen at build time with -DLIST_ORDER=<order>:
+ * LIFO_ORDER puts a freed block at the head of its list and ADDRESS_ORDER
+ * keeps every list sorted by address, so the first fit is the lowest.
+ * BEST_FIT lists are sorted by size instead */
+#define LIFO_ORDER    0
+#define ADDRESS_ORDER 1
+#ifndef LIST_ORDER
+#define LIST_ORDER LIFO_ORDER
+#endif
+#if LIST_ORDER == ADDRESS_ORDER && FIT_POLICY == BEST_FIT
+#error "BEST_FIT lists can not be address ordered"
+#endif
+
+/* Size classes of the segregated free lists. Sizes in [2^k, 2^(k+1))
+ * are split into SC_SUBS sub-buckets; sizes from LARGE_SIZE up share
+ * the last class, which is a tree instead of a list */
+#define SC_MIN_LOG  4                       /* log2 of smallest class */
+#define SC_SUB_BITS 2                       /* log2 of sub-buckets */
+#define SC_SUBS     (1 << SC_SUB_BITS)
+#define SC_POW2     10                      /* powers of two with lists */
+#define LARGE_CLASS (SC_POW2 << SC_SUB_BITS)
+#define LARGE_SIZE  (1 << (SC_MIN_LOG + SC_POW2))
+#define NUM_CLASSES (LARGE_CLASS + 1)
+
+/* The prologue holds one list header pointer per class. It is sized so
+ * that the payload of the first block, DSIZE past its end, is aligned */
+#define PROLOGUE_SIZE (ALIGN((NUM_CLASSES + 2) * WSIZE + DSIZE) - DSIZE)
+
+/* Given class c, compute address of its list header and the end marker */
+#define LIST_HEAD(c) (heap_listp + ((c) * WSIZE))
+#define LIST_END     (heap_listp + PROLOGUE_SIZE)
+
+/* Address of the root pointer of the large block tree */
+#define TREE_ROOT_PTR NEXT_FBLK_PTR(LIST_HEAD(LARGE_CLASS))
+#define TREE_ROOT     (char *)(GETTL(TREE_ROOT_PTR))
+
+/*Given large free block bp,compute address of its tree pointers and color*/
+#define LEFT_PTR(bp)   ((char *)(bp) + (WSIZE))
+#define RIGHT_PTR(bp)  ((char *)(bp) + (2 * WSIZE))
+#define PARENT_PTR(bp) ((char *)(bp) + (3 * WSIZE))
+#define COLOR_PTR(bp)  ((char *)(bp) + (4 * WSIZE))
+
+/*Given large free block bp,compute its children, parent and color*/
+#define LEFT(bp)   (char *)(GETTL(LEFT_PTR(bp)))
+#define RIGHT(bp)  (char *)(GETTL(RIGHT_PTR(bp)))
+#define PARENT(bp) (char *)(GETTL(PARENT_PTR(bp)))
+#define COLOR(bp)  GET(COLOR_PTR(bp))
+#define IS_RED(bp) ((bp) != NULL && COLOR(bp) == RED)
+
+#define BLACK 0
+#define RED   1
+
+/* Requests of up to SLAB_MAX bytes are served from slabs, 0 turns slabs
+ * off. A slab is a SLAB_SIZE aligned block cut into slots of one size,
+ * which have no header: free finds them by the slab_map bit of their
+ * SLAB_SIZE frame. Larger slabs or slot sizes leave more of each slab
+ * unused on the traces. The free slot bitmap has a bit for every
+ * ALIGNMENT bytes of the slab, enough for its smallest slots */
+#ifndef SLAB_MAX
+#define SLAB_MAX    16
+#endif
+#ifndef SLAB_SIZE
+#define SLAB_SIZE   (1 << 8)                /* Slab size and alignment */
+#endif
+#if SLAB_SIZE & (SLAB_SIZE - 1)
+#error "SLAB_SIZE must be a power of two"
+#endif
+#define SLAB_CLASSES (SLAB_MAX / ALIGNMENT + 1) /* One per slot size */
+#define SLAB_WORDS  ((SLAB_SIZE / ALIGNMENT + 63) / 64) /* Bitmap words */
+#define SLAB_HDR    ALIGN(4 * WSIZE + SLAB_WORDS * DSIZE) /* Header size */
+
+/* A block grown by realloc is given GROW_DIV-th of its size again as
+ * headroom, 0 turns headroom off. At most GROW_SLOTS blocks hold
+ * headroom at a time; it is given back when they are evicted, when the
+ * heap can not grow any more or when the block is freed */
+#ifndef GROW_DIV
+#define GROW_DIV    2
+#endif
+#define GROW_SLOTS  16
+
+/* A freed block that ends the heap and has at least TRIM_SIZE bytes is
+ * cut off the heap. The free rest of a split block, if at least
+ * RELEASE_SIZE bytes, gives the whole pages inside it back to the memory
+ * system and is marked RELEASED so that it does so only once. Freeing
+ * releases nothing, as the pages of a freed block are often soon used
+ * again. 0 turns either off */
+#ifndef TRIM_SIZE
+#define TRIM_SIZE    (1 << 22)
+#endif
+#define TRIM_PAD     (TRIM_SIZE / 2) /* Free space left at the end */
+#ifndef RELEASE_SIZE
+#define RELEASE_SIZE (1 << 22)
+#endif
+#define FREE_HDR     (6 * WSIZE) /* Header, links and color to keep */
+
+/* Requests of at least MMAP_SIZE bytes get a region of their own from
+ * mem_map, unmapped again when freed. 0 turns this off */
+#ifndef MMAP_SIZE
+#define MMAP_SIZE    (1 << 17)
+#endif
+#define MAPPED       PACK(0, 1 | GROWN) /* Header of a mapped block */
+#define MAP_HDR      (2 * DSIZE)        /* Length, offset and header */
+/* Check if a region for a block of size bytes would wrap around */
+#define MAP_TOO_BIG(size) ((size) > SIZE_MAX - MAP_HDR - mem_pagesize())
+
+/* Freed blocks of up to QUICK_MAX bytes are not coalesced at once but
+ * parked, still marked allocated, in a quick list of their size that
+ * malloc takes exact fits from. The parked blocks are coalesced all
+ * together when no free block fits or QUICK_LIMIT of them are parked.
+ * 0 turns the quick lists off */
+#ifndef QUICK_MAX
+#define QUICK_MAX    0
+#endif
+#ifndef QUICK_LIMIT
+#define QUICK_LIMIT  256
+#endif
+#define QUICK_BIN(size) (((size) - 2*DSIZE) / ALIGNMENT) /* By size */
+#define QUICK_BINS   (QUICK_BIN(QUICK_MAX) + 1)
+
+/* Built with -DINCR_CHECK, each call to the allocator checks the blocks
+ * it changed, their neighbours and the lists they moved between, instead
+ * of walking the whole heap. Up to INCR_LOG changed blocks are kept; a
+ * call that changes more gets a full mm_checkheap */
+#ifndef INCR_CHECK
+#define INCR_CHECK  0
+#endif
+#define INCR_LOG    64
+
+/* Given payload p, check if it is a mapped block and compute its size.
+ * No heap block has a size of 0 and GROWN set in its header */
+#define IS_MAPPED(p)   (GET((char *)(p) - WSIZE) == MAPPED)
+#define MAPPED_SIZE(p) (*(size_t *)((char *)(p) - MAP_HDR) - MAP_HDR)
+
+/* Given slab s, compute address of its header fields and first slot */
+#define SLAB_SLOT(s)  ((char *)(s))               /* slot size */
+#define SLAB_NFREE(s) ((char *)(s) + (WSIZE))     /* free slot count */
+#define SLAB_NEXT(s)  ((char *)(s) + (2 * WSIZE)) /* next partial slab */
+#define SLAB_PREV(s)  ((char *)(s) + (3 * WSIZE)) /* prev partial slab */
+#define SLAB_BITS(s)  ((unsigned long *)((char *)(s) + (4 * WSIZE)))
+#define SLAB_DATA(s)  ((char *)(s) + SLAB_HDR)
+
+/* Given pointer p, compute its slab frame and the frame's slab_map bit */
+#define SLAB_BASE(p)  ((char *)((size_t)(p) & ~(size_t)(SLAB_SIZE - 1)))
+#define SLAB_INDEX(p) (((size_t)(p) / SLAB_SIZE) - \
+                       ((size_t)heap_listp / SLAB_SIZE))
+
+/* Number of arenas for threaded programs, chosen at build time with
+ * -DARENAS=<n>. Threads are given arenas round robin and lock the arena
+ * for each call; 0 builds the single threaded allocator without locks.
+ * The heap of an arena grows to at most ARENA_SIZE bytes. Arena 0 grows
+ * with mem_sbrk, the others in ARENA_SIZE bytes of address space mapped
+ * when they are first used. Once its heap is full, an arena serves each
+ * request with a mapped block of its own */
+#ifndef ARENAS
+#define ARENAS 0
+#endif
+#ifndef ARENA_SIZE
+#define ARENA_SIZE MAX_HEAP
+#endif
+#if ARENA_SIZE > (1UL << 31)
+#error "ARENA_SIZE must fit the int of mem_sbrk"
+#endif
+
+/* With ARENAS each thread keeps up to TCACHE_COUNT freed blocks of each
+ * block size up to TCACHE_MAX in a cache that malloc and free use
+ * without locking; a full bin is flushed to the arena half at a time.
+ * 0 turns the cache off */
+#ifndef TCACHE_COUNT
+#define TCACHE_COUNT (ARENAS ? 8 : 0)
+#endif
+#if TCACHE_COUNT && !ARENAS
+#error "TCACHE_COUNT needs ARENAS"
+#endif
+#define TCACHE_MAX  256                     /* Largest cached block */
+#define TCACHE_BINS (SLAB_CLASSES + (TCACHE_MAX - 2*DSIZE) / ALIGNMENT + 1)
+
+#if MM_STATS_CLASSES != NUM_CLASSES
+#error "MM_STATS_CLASSES in mm.h must equal NUM_CLASSES"
+#endif
+
+/* Allocator state of one arena, a heap with its own free lists */
+struct arena {
+    char *heap_listp;  /* Pointer to first block */  
+    int lfree; /* Used to check if last block in heap is free*/
+    unsigned long class_map; /* Bit c set if list c is non-empty */
+#if LIST_ORDER == ADDRESS_ORDER
+    char *list_hint[LARGE_CLASS]; /* Last block put in each list */
+#endif
+#if SLAB_MAX
+    char *slab_list[SLAB_CLASSES]; /* Slabs with free slots, by size */
+    unsigned long slab_map[ARENA_SIZE / SLAB_SIZE / 64 + 1]; /* Frames */
+    size_t slab_map_hi; /* Highest slab_map word ever used */
+#endif
+#if GROW_DIV
+    char *grow_blk[GROW_SLOTS]; /* Blocks holding headroom */
+    size_t grow_used[GROW_SLOTS]; /* Block size they actually need */
+    int grow_next; /* Slot to evict when all are in use */
+#endif
+#if QUICK_MAX
+    char *quick[QUICK_BINS]; /* Parked blocks, by size */
+    int quick_count; /* Blocks parked in all the quick lists */
+#endif
+    struct mm_stats stats; /* Counters of the calls that reached it */
+#if INCR_CHECK
+    char *incr_log[INCR_LOG]; /* Blocks changed by the current call */
+    int incr_n; /* Blocks logged, INCR_LOG + 1 once the log overflowed */
+    unsigned long incr_classes; /* Bit c set if list c changed */
+#endif
+#if ARENAS
+    pthread_mutex_t lock; /* Held by the thread using the arena */
+    char *lo, *brk, *limit; /* Start, end and end of space of the heap */
+    size_t peak; /* Largest heap size since the arena was initialized */
+    void *remote; /* Stack of blocks other arenas' threads freed */
+#endif
+};
 
 /* Global variables */
-static char *heap_listp = 0;  /* Pointer to first block */  
-static int lfree = 0; /* Used to check if last block in heap is free*/
+#if ARENAS
+static struct arena arenas[ARENAS] = {
+    [0 ... ARENAS - 1] = { .lock = PTHREAD_MUTEX_INITIALIZER }
+};
+static __thread struct arena *cur_arena; /* Arena of the calling thread */
+static int arena_next = 0; /* Arena given to the next new thread */
+static pthread_mutex_t mem_lock = PTHREAD_MUTEX_INITIALIZER; /* memlib */
+static pthread_once_t fork_once = PTHREAD_ONCE_INIT; /* Sets fork hooks */
+#else
+static struct arena arenas[1];
+#define cur_arena (&arenas[0])
+#endif
+#if TCACHE_COUNT
+static __thread void *tcache[TCACHE_BINS]; /* Cached blocks, by size */
+static __thread int tcache_count[TCACHE_BINS]; /* Blocks in each bin */
+static __thread int tcache_used; /* Set once the thread cached a block */
+static pthread_key_t tcache_key; /* Flushes the cache at thread exit */
+static pthread_once_t tcache_once = PTHREAD_ONCE_INIT;
+#endif
+
+/* The state of the arena in use, as the rest of the code sees it */
+#define heap_listp  (cur_arena->heap_listp)
+#define lfree       (cur_arena->lfree)
+#define class_map   (cur_arena->class_map)
+#define list_hint   (cur_arena->list_hint)
+#define slab_list   (cur_arena->slab_list)
+#define slab_map    (cur_arena->slab_map)
+#define slab_map_hi (cur_arena->slab_map_hi)
+#define grow_blk    (cur_arena->grow_blk)
+#define grow_used   (cur_arena->grow_used)
+#define grow_next   (cur_arena->grow_next)
+#define quick       (cur_arena->quick)
+#define quick_count (cur_arena->quick_count)
+
+/* Count n events of the given kind in the statistics of the arena */
+#define STAT_ADD(field, n) (cur_arena->stats.field += (n))
+
+/* Log block p or a change to list c for the incremental checker, or
+ * drop p from the log once it is merged into the block before it */
+#if INCR_CHECK
+#define INCR_TOUCH(p)  incr_touch((char *)(p))
+#define INCR_CLASS(c)  (cur_arena->incr_classes |= 1UL << (c))
+#define INCR_FORGET(p) incr_forget((char *)(p))
+#else
+#define INCR_TOUCH(p)
+#define INCR_CLASS(c)
+#define INCR_FORGET(p)
+#endif
+
+/* First and last byte of the heap of the arena in use */
+#if ARENAS
+#define HEAP_LO() ((void *)cur_arena->lo)
+#define HEAP_HI() ((void *)(cur_arena->brk - 1))
+#else
+#define HEAP_LO() mem_heap_lo()
+#define HEAP_HI() mem_heap_hi()
+#endif
 
 /* Function prototypes for internal helper routines */
 static void *extend_heap(size_t words); /* Expand heap size*/
 static void place(void *bp, size_t asize); /*Place an allocated block in heap*/
-static void *find_fit(size_t asize); /* Find first free block of size asize */
+static void *find_fit(size_t asize); /* Find free block of size asize */
 static void *coalesce(void *bp); /* Coalesce adjacent free blocks into one */
+static void deleteBlock(void *bp); /* Remove a free block from its list */
 static int in_heap(const void *p); /* Check if pointer is in heap */
+static int tree_less(const char *a, const char *b); /* Tree key order */
+static void tree_insert(char *bp); /* Add a large free block to the tree */
+static void tree_delete(char *bp); /* Remove a large free block */
+static void *tree_fit(size_t asize, int *seen); /* Smallest block >= asize */
+static void shrink_block(char *bp, size_t asize); /* Free tail of block */
+static void trim_block(char *bp); /* Cut a large last block off the heap */
+static void *map_block(size_t size); /* Allocate a block in its own region */
+static void *map_aligned(size_t align, size_t size); /* Aligned map_block */
+static void unmap_block(void *p); /* Free a mapped block */
+static void arena_free(void *bp); /* Free a block of the arena in use */
+static void free_block(char *bp); /* Free and coalesce an allocated block */
+static void *heap_malloc(size_t size); /* Allocate without counting it */
+static void *heap_alloc(size_t size); /* Allocate a block of the heap */
+static void *alloc_aligned(size_t align, size_t size); /* Aligned malloc */
+static int slab_owns(const void *p); /* Check if pointer is a slab slot */
+static void *slab_alloc(size_t size); /* Allocate a slot from a slab */
+static void slab_free(void *p); /* Free a slab slot */
+#if SLAB_MAX
+static unsigned int slab_count_bits(char *s); /* Free slots of a slab */
+#endif
+static void grow_track(char *bp, size_t used); /* Record block headroom */
+static void grow_forget(char *bp); /* Drop a freed block's record */
+static size_t grow_used_size(char *bp); /* Block size less headroom */
+static int grow_reclaim(void); /* Give all headroom back */
+#if QUICK_MAX
+static int quick_flush(void); /* Coalesce all parked blocks */
+#endif
+#if INCR_CHECK
+static void incr_checkheap(void); /* Check the blocks the call changed */
+
+/*
+ * incr_touch - Log block or list header p as changed by this call
+ */
+inline static void incr_touch(char *p)
+{
+    if (cur_arena->incr_n < INCR_LOG)
+        cur_arena->incr_log[cur_arena->incr_n++] = p;
+    else
+        cur_arena->incr_n = INCR_LOG + 1;
+}
+
+/*
+ * incr_forget - Drop p from the log, it is no longer a block
+ */
+inline static void incr_forget(char *p)
+{
+    int i;
+
+    for (i = 0; i < cur_arena->incr_n && i < INCR_LOG; i++)
+        if (cur_arena->incr_log[i] == p)
+            cur_arena->incr_log[i] = NULL;
+}
+#endif
+
+/*
+ * size_class - Return the free list index for a block of the given size.
+ * The power of two is found with a count-leading-zeros instruction and
+ * the next SC_SUB_BITS bits below it select the sub-bucket
+ */
+inline static int size_class(size_t size){
+    int lg = 63 - __builtin_clzl(size);
+    int c = ((lg - SC_MIN_LOG) << SC_SUB_BITS) |
+        (int)((size >> (lg - SC_SUB_BITS)) & (SC_SUBS - 1));
+    return (c < LARGE_CLASS) ? c : LARGE_CLASS;
+}
 
 /* EnqueueBlock - This function places a free block in front of the list.
  * It checks the size of the free block and places the block in its
@@ -120,114 +515,293 @@ static int in_heap(const void *p); /* Check if pointer is in heap */
  * block in the list 
  * */
 inline static char *enqueueBlock(char * const block){
-    void * fhp; 
-
-    /* Set list header pointer based on size of block bieng enqueued */
-    if(GET_SIZE(block) < BKT1)
-        fhp = heap_listp;
-    else if(GET_SIZE(block)<BKT2)
-        fhp = heap_listp + (DSIZE);
-    else if(GET_SIZE(block)<BKT3)
-        fhp = heap_listp + (2*DSIZE);
-    else if(GET_SIZE(block)<BKT4)
-        fhp = heap_listp + (3*DSIZE);
-    else if(GET_SIZE(block)<BKT5)
-        fhp = heap_listp + (4*DSIZE);
-    else if(GET_SIZE(block)<BKT6)
-        fhp = heap_listp + (5*DSIZE);
-    else if(GET_SIZE(block)<BKT7)
-        fhp = heap_listp + (6*DSIZE);
-    else if(GET_SIZE(block)<BKT8)
-        fhp = heap_listp + (7*DSIZE);
-    else if(GET_SIZE(block)<BKT9)
-        fhp = heap_listp + (8*DSIZE);
-    else if(GET_SIZE(block)<BKT10)
-        fhp = heap_listp + (9*DSIZE);
-    else if(GET_SIZE(block)<BKT11)
-        fhp = heap_listp + (10*DSIZE);
-    else if(GET_SIZE(block)<BKT12)
-        fhp = heap_listp + (11*DSIZE);
-    else
-        fhp = heap_listp + (12*DSIZE);
+    int c = size_class(GET_SIZE(block));
+    char *fhp = LIST_HEAD(c);
+
+    class_map |= 1UL << c;
+    INCR_TOUCH(block);
+    INCR_CLASS(c);
+    if(c == LARGE_CLASS){ /* Large blocks go in the tree */
+        tree_insert(block);
+        return block;
+    }
+
+#if FIT_POLICY == BEST_FIT
+    /* Insert after the last smaller block to keep the list size ordered */
+    while(GET_SIZE(NEXT_FREE_BLOCK(fhp)) > 0 &&
+        GET_SIZE(NEXT_FREE_BLOCK(fhp)) < GET_SIZE(block))
+        fhp = NEXT_FREE_BLOCK(fhp);
+#elif LIST_ORDER == ADDRESS_ORDER
+    /* Insert after the last lower block to keep the list address ordered,
+     * searching from the block put in the list last if it is lower */
+    if(list_hint[c] != NULL && list_hint[c] < block)
+        fhp = list_hint[c];
+    while(GET_SIZE(NEXT_FREE_BLOCK(fhp)) > 0 &&
+        NEXT_FREE_BLOCK(fhp) < block)
+        fhp = NEXT_FREE_BLOCK(fhp);
+    list_hint[c] = block;
+#endif
 
     /*Update next pointer value of block*/
     PUTDL(NEXT_FBLK_PTR(block),GETDL(NEXT_FBLK_PTR(fhp)));
     PUTDL(PREV_FBLK_PTR(block),(fhp)); /*Update prev pointer value of block*/
     PUTDL(NEXT_FBLK_PTR(fhp),block); /* Update list header pointer */
     void* nextblk = NEXT_FREE_BLOCK(block);
+    INCR_TOUCH(fhp);
+    INCR_TOUCH(nextblk);
     if(!GET_ALLOC(nextblk)){   /*If next free block is allocated, update*/
         PUTDL(PREV_FBLK_PTR(nextblk),block); /*pointer to prev free block*/
     }
    return block;
 }
 
+/*
+ * heap_sbrk - Extend the heap of the arena in use by incr bytes and
+ * return the start of the new area, or (void *)-1 if it is full
+ */
+inline static void *heap_sbrk(size_t incr)
+{
+    if (incr > INT_MAX) /* More than mem_sbrk can take */
+        return (void *)-1;
+#if ARENAS
+    char *old = cur_arena->brk;
+
+    if (incr > (size_t)(cur_arena->limit - old)) /* Heap is full */
+        return (void *)-1;
+    if (cur_arena == &arenas[0]){
+        pthread_mutex_lock(&mem_lock);
+        old = mem_sbrk(incr);
+        pthread_mutex_unlock(&mem_lock);
+        if (old == (void *)-1)
+            return (void *)-1;
+    }
+    cur_arena->brk = old + incr;
+    cur_arena->peak = MAX(cur_arena->peak,
+        (size_t)(cur_arena->brk - cur_arena->lo));
+    return old;
+#else
+    return mem_sbrk(incr);
+#endif
+}
+
+/*
+ * heap_shrink - Cut decr bytes off the end of the heap of the arena in
+ * use and give them back to the memory system
+ */
+inline static void heap_shrink(size_t decr)
+{
+#if ARENAS
+    cur_arena->brk -= decr;
+    if (cur_arena != &arenas[0]){
+        mem_release(cur_arena->brk, decr);
+        return;
+    }
+    pthread_mutex_lock(&mem_lock);
+    mem_sbrk(-(int)decr);
+    pthread_mutex_unlock(&mem_lock);
+#else
+    mem_sbrk(-(int)decr);
+#endif
+}
+
 /* 
- * mm_init - Initialize the memory manager
+ * arena_init - Initialize the arena in use with an empty heap
  * The pointers to segregated free lists are placed 
  * between the header and footer of prologue block
  */
-int mm_init(void) 
+static int arena_init(void) 
 {
+    int c;
+
+#if ARENAS
+    char *lo;
+
+    /* lo and limit are read by arena_of in other threads without a lock */
+    if (cur_arena == &arenas[0]){ /* Grows with mem_sbrk */
+        lo = mem_heap_lo();
+        cur_arena->brk = (char *)mem_heap_hi() + 1;
+        __atomic_store_n(&cur_arena->lo, lo, __ATOMIC_RELAXED);
+        __atomic_store_n(&cur_arena->limit, lo + ARENA_SIZE, __ATOMIC_RELAXED);
+    }
+    else{
+        if (cur_arena->lo == NULL){ /* First use - map its space */
+            lo = mmap(NULL, ARENA_SIZE, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+            if (lo == MAP_FAILED)
+                return -1;
+            __atomic_store_n(&cur_arena->lo, lo, __ATOMIC_RELAXED);
+            __atomic_store_n(&cur_arena->limit, lo + ARENA_SIZE,
+                __ATOMIC_RELAXED);
+        }
+        cur_arena->brk = cur_arena->lo;
+    }
+    cur_arena->peak = 0;
+#endif
+    memset(&cur_arena->stats, 0, sizeof(cur_arena->stats));
+#if INCR_CHECK
+    cur_arena->incr_n = 0;
+    cur_arena->incr_classes = 0;
+#endif
     lfree = 0;
+    class_map = 0;
+#if LIST_ORDER == ADDRESS_ORDER
+    memset(list_hint, 0, sizeof(list_hint));
+#endif
+#if SLAB_MAX
+    memset(slab_list, 0, sizeof(slab_list));
+    memset(slab_map, 0, (slab_map_hi + 1) * sizeof(*slab_map));
+    slab_map_hi = 0;
+#endif
+#if GROW_DIV
+    memset(grow_blk, 0, sizeof(grow_blk));
+    grow_next = 0;
+#endif
+#if QUICK_MAX
+    memset(quick, 0, sizeof(quick));
+    quick_count = 0;
+#endif
     /* Create the initial empty heap */
-    if ((heap_listp = mem_sbrk(29*WSIZE)) == (void *)-1) 
+    if ((heap_listp = heap_sbrk(PROLOGUE_SIZE + 2*WSIZE)) == (void *)-1){
+        heap_listp = 0;
         return -1;
-    PUT(heap_listp, PACK((14*DSIZE), 1)); /* Prologue header */
+    }
+    PUT(heap_listp, PACK(PROLOGUE_SIZE, 1)); /* Prologue header */
 
     /*Headers of segregated free list. Initialized pointing to epilogue block*/
-    PUTDL((heap_listp + (1*WSIZE)),(heap_listp + (28*WSIZE)));
-    PUTDL(heap_listp + (3*WSIZE),(heap_listp + (28*WSIZE)));
-    PUTDL(heap_listp + (5*WSIZE),(heap_listp + (28*WSIZE))); 
-    PUTDL(heap_listp + (7*WSIZE),(heap_listp + (28*WSIZE)));
-    PUTDL(heap_listp + (9*WSIZE),(heap_listp + (28*WSIZE)));
-    PUTDL(heap_listp + (11*WSIZE),(heap_listp + (28*WSIZE)));
-    PUTDL(heap_listp + (13*WSIZE),(heap_listp + (28*WSIZE))); 
-    PUTDL(heap_listp + (15*WSIZE),(heap_listp + (28*WSIZE)));
-    PUTDL(heap_listp + (17*WSIZE),(heap_listp + (28*WSIZE)));
-    PUTDL(heap_listp + (19*WSIZE),(heap_listp + (28*WSIZE)));
-    PUTDL(heap_listp + (21*WSIZE),(heap_listp + (28*WSIZE)));
-    PUTDL(heap_listp + (23*WSIZE),(heap_listp + (28*WSIZE)));
-    PUTDL(heap_listp + (25*WSIZE),(heap_listp + (28*WSIZE)));
-
-    PUT(heap_listp + (27*WSIZE), PACK((14*DSIZE),1)); /*Prologue footer*/
-    PUT(heap_listp + (28*WSIZE), PACK(0, 1));     /* Epilogue header */ 
+    for (c = 0; c < LARGE_CLASS; c++)
+        PUTDL(NEXT_FBLK_PTR(LIST_HEAD(c)), LIST_END);
+    PUTTL(TREE_ROOT_PTR, NULL); /* Tree of large blocks is empty */
+
+    PUT(LIST_END - WSIZE, PACK(PROLOGUE_SIZE, 1)); /*Prologue footer*/
+    PUT(LIST_END, PACK(0, 1));     /* List end marker */
+    PUT(LIST_END + WSIZE, PACK(0, 1 | PREV_ALLOC)); /* Epilogue header */
     /* Extend the empty heap with a free block of CHUNKSIZE bytes */
     if (extend_heap(CHUNKSIZE/WSIZE) == NULL) 
         return -1;
     return 0;
 }
 
+/*
+ * adjust_size - Return the block size for a payload of size bytes:
+ * size plus header rounded up to alignment, at least the minimum block.
+ * A size no heap can hold gives a block size just past ARENA_SIZE
+ * rather than wrapping around to a small one
+ */
+inline static size_t adjust_size(size_t size)
+{
+    if (size <= (2*DSIZE - WSIZE))                                          
+        return 2*DSIZE;                                        
+    if (size >= ARENA_SIZE)
+        return (size_t)ARENA_SIZE + DSIZE;
+    return ALIGN(size + WSIZE);
+}
+
+/*
+ * block_size - Return the size of the block, slot or region allocated
+ * at payload p
+ */
+inline static size_t block_size(void *p)
+{
+    if (slab_owns(p))
+        return GET(SLAB_SLOT(SLAB_BASE(p)));
+    if (IS_MAPPED(p))
+        return MAPPED_SIZE(p);
+    return GET_SIZE(HDRP((char *)p - WSIZE));
+}
+
+/*
+ * arena_malloc - Allocate a block with at least size bytes of payload
+ * from the arena in use and count it in the arena's statistics
+ */
+static void *arena_malloc(size_t size)
+{
+    void *p = heap_malloc(size);
+
+    if (p != NULL){
+        STAT_ADD(mallocs, 1);
+        STAT_ADD(requested, size);
+        STAT_ADD(granted, block_size(p));
+    }
+    return p;
+}
+
 /* 
- * malloc - Allocate a block with at least size bytes of payload 
+ * heap_malloc - Allocate a block with at least size bytes of payload 
+ * from the arena in use. If its heap has no room, the block gets a
+ * region of its own instead
+ */
+static void *heap_malloc(size_t size) 
+{
+    void *p = NULL;
+
+    /* Ignore spurious requests */
+    if (size == 0)
+        return NULL;
+#if MMAP_SIZE
+    /* Huge requests get a region of their own */
+    if (size >= MMAP_SIZE)
+        return map_block(size);
+#endif
+    if (heap_listp != 0 || arena_init() == 0){
+        /* Small requests are served from slabs */
+        if (SLAB_MAX && size <= SLAB_MAX)
+            p = slab_alloc(size);
+        else
+            p = heap_alloc(size);
+    }
+    if (p == NULL)
+        p = map_block(size);
+    return p;
+}
+
+/*
+ * heap_alloc - Allocate a block of the heap of the arena in use, never
+ * a slab slot or mapped block, with at least size bytes of payload
  */
-void *malloc(size_t size) 
+static void *heap_alloc(size_t size)
 {
     size_t asize;      /* Adjusted block size */
     size_t extendsize; /* Amount to extend heap if no fit */
     void *bp;
-    if (heap_listp == 0){
-        mm_init();
-    }
-    /* Ignore spurious requests */
-    if (size == 0)
+
+    /* Adjust block size to include header and alignment reqs. */
+    asize = adjust_size(size);
+    if (asize > ARENA_SIZE){ /* Larger than any heap */
+        errno = ENOMEM;
         return NULL;
-    /* Adjust block size to include overhead and alignment reqs. */
-    if (size <= (2*DSIZE))                                          
-        asize = 3*DSIZE;                                        
-    else
-        asize = DSIZE * ((size + (DSIZE) + (DSIZE-1)) / DSIZE);
+    }
+#if QUICK_MAX
+    /* A parked block of the same size is taken as it is */
+    if (asize <= QUICK_MAX && (bp = quick[QUICK_BIN(asize)]) != NULL){
+        quick[QUICK_BIN(asize)] = GETTL(NEXT_FBLK_PTR(bp));
+        quick_count--;
+        return (bp + (WSIZE));
+    }
+#endif
     /* Search the free list for a fit */
     if ((bp = find_fit(asize)) != NULL) {  
         place(bp, asize);                  
         void * retp = (bp + (WSIZE));
         return retp;
     }
+#if QUICK_MAX
+    /* No fit - coalesce the parked blocks and search again */
+    if (quick_flush()){
+        lfree = 0;
+        return heap_alloc(size);
+    }
+#endif
     /* last block on heap is free - get only the required momory*/
     asize = asize - lfree;
     /* No fit found. Get more memory and place the block */
     extendsize = MAX(asize,CHUNKSIZE);
-    if ((bp = extend_heap(extendsize/WSIZE)) == NULL)  
-        return NULL;
+    if ((bp = extend_heap(extendsize/WSIZE)) == NULL){
+        /* Out of memory - retry after giving back realloc headroom */
+        lfree = 0;
+        if (!grow_reclaim())
+            return NULL;
+        return heap_alloc(size);
+    }
     asize = asize + lfree;
     lfree = 0;
     place(bp, asize);     
@@ -235,152 +809,972 @@ void *malloc(size_t size)
     return (bp + (WSIZE));
 }
 
-/* 
- * free - Free a block 
+/*
+ * free_block - Mark allocated block bp free and coalesce it
  */
-void free(void *bp)
+static void free_block(char *bp)
+{
+    size_t size = GET_SIZE(HDRP(bp));
+
+    /*update header and footer of block and the next block's header */
+    PUT(HDRP(bp), PACK(size, GET_PREV_ALLOC(HDRP(bp))));
+    PUT(FTRP(bp), PACK(size, 0));
+    CLEAR_PREV_ALLOC(HDRP(NEXT_BLKP(bp)));
+    trim_block(coalesce(bp));
+}
+
+#if QUICK_MAX
+/*
+ * quick_flush - Free and coalesce every parked block. Returns the
+ * number of blocks that were parked
+ */
+static int quick_flush(void)
+{
+    int b, n = quick_count;
+    char *bp;
+
+    for (b = 0; quick_count > 0 && b < QUICK_BINS; b++){
+        while ((bp = quick[b]) != NULL){
+            quick[b] = GETTL(NEXT_FBLK_PTR(bp));
+            quick_count--;
+            free_block(bp);
+        }
+    }
+    return n;
+}
+#endif
+
+/*
+ * arena_free - Free a block of the arena in use. Small blocks are
+ * parked in the quick lists instead of being coalesced
+ */
+static void arena_free(void *bp)
 {
     if (bp == 0) 
         return;
 
+    STAT_ADD(frees, 1);
+    if(slab_owns(bp)){
+        slab_free(bp);
+        return;
+    }
     bp = (void *)bp - WSIZE;
 
     if(!in_heap(bp)){
+        if(IS_MAPPED(bp + WSIZE))
+            unmap_block(bp + WSIZE);
         return;
     }
-    size_t size = GET_SIZE(HDRP(bp));
     if (heap_listp == 0){
-        mm_init();
+        arena_init();
     }
-    /*update header and footer of block */
-    PUT(HDRP(bp), PACK(size, 0));
-    PUT(FTRP(bp), PACK(size, 0));
-    coalesce(bp);
+    if(GET_GROWN(HDRP(bp))){
+        grow_forget(bp);
+    }
+#if QUICK_MAX
+    else if(GET_SIZE(HDRP(bp)) <= QUICK_MAX){
+        int b = QUICK_BIN(GET_SIZE(HDRP(bp)));
+
+        if(quick_count == QUICK_LIMIT)
+            quick_flush();
+        PUTTL(NEXT_FBLK_PTR(bp), quick[b]);
+        quick[b] = bp;
+        quick_count++;
+        return;
+    }
+#endif
+    free_block(bp);
 }
 
 /*
- * realloc - Reallocates size memory at a new pointer
- * and copies old data to it 
+ * arena_realloc - Reallocates size memory, in place when possible
+ * A block is shrunk by freeing its tail, and grows into the next block
+ * if that is free and large enough. A block at the end of the heap
+ * grows by extending the heap. Otherwise the data is copied to a new
+ * block. A block that grows is given headroom of GROW_DIV-th of its
+ * size, so that growing it again a little at a time fits in place
  */
-void *realloc(void *ptr, size_t size)
+static void *arena_realloc(void *ptr, size_t size)
 {
-    size_t oldsize;
+    size_t oldsize, asize, csize, target;
     void *newptr;
-    void *nptr;
+    char *nptr, *next;
 
     /* If size == 0 then this is just free, and we return NULL. */
     if(size == 0) {
-        mm_free(ptr);
+        arena_free(ptr);
         return 0;
     }
 
     /* If oldptr is NULL, then this is just malloc. */
     if(ptr == NULL) {
-        return malloc(size);
+        return arena_malloc(size);
     }
 
-    nptr = ptr - WSIZE;
-    /*If pointer is not in heap or free*/
-    if(!in_heap(nptr) || !GET_ALLOC(nptr)){
-        return 0;
+    nptr = (char *)ptr - WSIZE;
+    asize = adjust_size(size);
+    target = asize;
+    if(slab_owns(ptr)){
+        oldsize = GET(SLAB_SLOT(SLAB_BASE(ptr)));
+        if(size <= oldsize) /* Still fits in its slot */
+            return ptr;
+    }
+    else if(IS_MAPPED(ptr)){
+        oldsize = MAPPED_SIZE(ptr);
+#if MMAP_SIZE
+        if(size <= oldsize && size >= MMAP_SIZE / 2) /* Still fits */
+            return ptr;
+#endif
+    }
+    else{
+        /*If pointer is not in heap or free*/
+        if(!in_heap(nptr) || !GET_ALLOC(nptr)){
+            return 0;
+        }
+        oldsize = GET_SIZE(HDRP(nptr)) - WSIZE; /* Payload size */
+        csize = GET_SIZE(HDRP(nptr));
+        next = NEXT_BLKP(nptr);
+        /* Growing blocks and blocks that grew before keep headroom.
+         * A size too big for the heap is only ever copied out */
+        if(GROW_DIV && asize <= ARENA_SIZE &&
+            (csize < asize || GET_GROWN(HDRP(nptr))))
+            target = ALIGN(asize + asize / MAX(GROW_DIV, 1));
+
+        /* Block at the end of the heap - extend it by the shortfall.
+         * It can always grow in place, so it is given no headroom. If
+         * the heap can not grow, the block is copied instead */
+        if(csize < asize && asize <= ARENA_SIZE &&
+            (GET_SIZE(HDRP(next)) == 0 || (!GET_ALLOC(HDRP(next)) &&
+            GET_SIZE(HDRP(NEXT_BLKP(next))) == 0))){
+            if(GET_SIZE(HDRP(next)) == 0 || csize + GET_SIZE(next) < asize)
+                extend_heap(MAX(2*DSIZE, asize - csize -
+                    (GET_ALLOC(next) ? 0 : GET_SIZE(next))) / WSIZE);
+            target = asize;
+        }
+
+        /* Grow into the next block if it is free and large enough */
+        if(csize < asize && !GET_ALLOC(HDRP(next)) &&
+            csize + GET_SIZE(HDRP(next)) >= asize){
+            deleteBlock(next);
+            INCR_FORGET(next);
+            INCR_TOUCH(nptr);
+            csize += GET_SIZE(HDRP(next));
+            PUT(HDRP(nptr), PACK(csize, 1 | GET_PREV_ALLOC(HDRP(nptr)) |
+                GET_GROWN(HDRP(nptr))));
+            SET_PREV_ALLOC(HDRP(NEXT_BLKP(nptr)));
+        }
+
+        if(asize <= csize){ /* Fits in place - free any unneeded tail */
+            if(target < csize)
+                shrink_block(nptr, target);
+            grow_track(nptr, asize);
+            return ptr;
+        }
     }
 
-    newptr = malloc(size);
+    /* Copy to a new block with headroom, or without if that fails */
+    newptr = NULL;
+    if(target > asize)
+        newptr = arena_malloc(target - WSIZE);
+    if(!newptr)
+        newptr = arena_malloc(size);
     /* If realloc() fails the original block is left untouched  */
     if(!newptr) {
         return 0;
     }
 
     /* Copy the old data. */
-    oldsize = GET_SIZE(HDRP(ptr));
     if(size < oldsize) oldsize = size;
     memcpy(newptr, ptr, oldsize);
 
     /* Free the old block. */
-    mm_free(ptr);
+    arena_free(ptr);
+    if(target > asize && !slab_owns(newptr) && !IS_MAPPED(newptr))
+        grow_track((char *)newptr - WSIZE, asize);
 
     return newptr;
 }
 
-/* Calloc - Allocates memory for an array of nmemb 
- * elements of size bytes
- * All bytes are initialized to 0
+#if ARENAS
+/*
+ * fork_lock - Take every lock before fork, arenas first as the calls
+ * do, so that no other thread holds one in the child
  */
-void *calloc(size_t nmemb, size_t size){
+static void fork_lock(void)
+{
+    int i;
 
-    void *newptr;
-    size_t num = nmemb * size;
+    for (i = 0; i < ARENAS; i++)
+        pthread_mutex_lock(&arenas[i].lock);
+    pthread_mutex_lock(&mem_lock);
+}
 
-    newptr = malloc(num);
- 
-    if(!newptr) //if malloc fails
-        return NULL;
+/*
+ * fork_unlock - Release the locks fork_lock took, in parent and child
+ */
+static void fork_unlock(void)
+{
+    int i;
 
-    memset(newptr, 0, num);
-    return newptr;
+    pthread_mutex_unlock(&mem_lock);
+    for (i = 0; i < ARENAS; i++)
+        pthread_mutex_unlock(&arenas[i].lock);
 }
 
 /*
- * checkblock - Check alignment of each block and
- *              if header and footer values match
+ * fork_init - Hold the locks across fork
  */
-static void checkblock(void *bp) 
+static void fork_init(void)
 {
-    if ((size_t)(bp + WSIZE) % 8){
-        printf("Error: %p is not doubleword aligned\n", bp);
-        exit(1);
-    }
-    if (GET(HDRP(bp)) != GET(FTRP(bp))){
-        printf("Error: %p header do not match footer\n", bp);
-       exit(1);
+    pthread_atfork(fork_lock, fork_unlock, fork_unlock);
+}
+
+/*
+ * arena_get - Return the arena of the calling thread, giving a new
+ * thread the next arena round robin
+ */
+inline static struct arena *arena_get(void)
+{
+    if (cur_arena == NULL){
+        pthread_once(&fork_once, fork_init);
+        cur_arena = &arenas[__atomic_fetch_add(&arena_next, 1,
+            __ATOMIC_RELAXED) % ARENAS];
     }
+    return cur_arena;
 }
 
-/* 
- * mm_checkheap - Check the heap for correctness.
- * Check correctness of header
- * Calls checkblock for all blocks iteratively
- * Check if next and previous pointers are consistent
- * Check if the pointers in free list are in_heap
- * Compare the number of free blocks iteratively and in free list
- * Check if end marker (0/1) is in place
+/*
+ * arena_of - Return the arena whose space holds p, or NULL. The space
+ * of arena 0 above the break is not its own, and may hold the mapped
+ * space of other arenas, so arena 0 is tried last
  */
-void mm_checkheap(int lineno)  
-{ 
-    void *bp = heap_listp;
-    int x = 0;
-    int nfblk = 0; /* free block counter */
+inline static struct arena *arena_of(const void *p)
+{
+    int i;
 
-    /* Check alignment of header */
-    if((GET_SIZE(HDRP(heap_listp)) != 14*DSIZE)||!GET_ALLOC(HDRP(heap_listp))){
-        printf("Error - Line: %d Bad prologue header\n", lineno);
-        exit(1);
-    }
-    bp =  heap_listp + (28*WSIZE);
+    for (i = ARENAS - 1; i >= 0; i--)
+        if ((char *)p >= __atomic_load_n(&arenas[i].lo, __ATOMIC_RELAXED) &&
+            (char *)p < __atomic_load_n(&arenas[i].limit, __ATOMIC_RELAXED))
+            return &arenas[i];
+    return NULL;
+}
 
-    /*Check if end marker is in place */
-    if(GET_SIZE(bp) && !GET_ALLOC(bp)){
-        printf("List end pointer not in place\n");
-        exit(1);
-    }
-    /* Check each block iteratively */
-    for (bp+=WSIZE; in_heap(bp); bp = NEXT_BLKP(bp)){
-        checkblock(bp);
-        /*Count number of free blocks*/
-        if(!GET_ALLOC(bp))
-            nfblk+=1;   
-    }
+/*
+ * arena_remote_free - Push bp on the stack of blocks freed into arena a
+ * by another arena's thread, without taking the lock of a. The link is
+ * kept in the payload; the owner frees the blocks when it next locks a
+ */
+static void arena_remote_free(struct arena *a, void *bp)
+{
+    void *head = __atomic_load_n(&a->remote, __ATOMIC_RELAXED);
 
-    /* Check all the segregated free lists */
-    for(x = 0; x < 13; x++){
-        for (bp = NEXT_FREE_BLOCK(heap_listp+(x*DSIZE));GET_SIZE(HDRP(bp)) > 0;
-            bp = NEXT_FREE_BLOCK(bp)){
+    do
+        *(void **)bp = head;
+    while (!__atomic_compare_exchange_n(&a->remote, &head, bp, 1,
+        __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+#endif
 
-            /* Check if block is marked as free */
-            if(GET_ALLOC(HDRP(bp))){
-                printf("Error: %p - Block in free list is allocated\n", bp);
-                exit(1);
-            }
+/*
+ * arena_enter - Lock the arena in use and free the blocks other
+ * threads freed into it
+ */
+inline static void arena_enter(void)
+{
+#if ARENAS
+    void *bp, *next;
+
+    pthread_mutex_lock(&cur_arena->lock);
+    if (__atomic_load_n(&cur_arena->remote, __ATOMIC_RELAXED) == NULL)
+        return;
+    bp = __atomic_exchange_n(&cur_arena->remote, NULL, __ATOMIC_ACQUIRE);
+    for (; bp != NULL; bp = next){
+        next = *(void **)bp;
+        arena_free(bp);
+    }
+#endif
+}
+
+/*
+ * arena_exit - Unlock the arena in use
+ */
+inline static void arena_exit(void)
+{
+#if INCR_CHECK
+    incr_checkheap();
+#endif
+#if ARENAS
+    pthread_mutex_unlock(&cur_arena->lock);
+#endif
+}
+
+#if TCACHE_COUNT
+/*
+ * tcache_bin - Return the cache bin of the block malloc(size) would
+ * allocate, or -1 if blocks of that size are not cached. Slab slots
+ * come first, by slot size, then heap blocks by block size
+ */
+inline static int tcache_bin(size_t size)
+{
+    size_t asize;
+
+    if (size == 0)
+        return -1;
+    if (SLAB_MAX && size <= SLAB_MAX)
+        return ALIGN(size) / ALIGNMENT;
+    asize = adjust_size(size);
+    return (asize <= TCACHE_MAX) ?
+        (int)(SLAB_CLASSES + (asize - 2*DSIZE) / ALIGNMENT) : -1;
+}
+
+/*
+ * tcache_block_bin - Return the cache bin of allocated block p of the
+ * arena in use, or -1 if it is not to be cached. Other threads of the
+ * arena only change the size of a GROWN block, and only GROWN blocks
+ * larger than TCACHE_MAX exist, so reading the header without the lock
+ * gives the right bin or -1. The header and slab_map are read
+ * atomically, as the other threads write them
+ */
+inline static int tcache_block_bin(void *p)
+{
+    unsigned int hdr;
+
+    if (slab_owns(p))
+        return GET(SLAB_SLOT(SLAB_BASE(p))) / ALIGNMENT;
+    hdr = GET_SHARED(HDRP((char *)p - WSIZE));
+    if ((hdr & GROWN) || !(hdr & 0x1) || (hdr & ~0x7) > TCACHE_MAX)
+        return -1;
+    return SLAB_CLASSES + ((hdr & ~0x7) - 2*DSIZE) / ALIGNMENT;
+}
+
+/*
+ * tcache_flush - Free up to n blocks of cache bin b into the arena in
+ * use, which the caller holds locked
+ */
+static void tcache_flush(int b, int n)
+{
+    void *bp;
+
+    while (n-- > 0 && (bp = tcache[b]) != NULL){
+        tcache[b] = *(void **)bp;
+        tcache_count[b]--;
+        arena_free(bp);
+    }
+}
+
+/*
+ * tcache_exit - Flush the whole cache of a thread that exits
+ */
+static void tcache_exit(void *unused)
+{
+    int b;
+
+    arena_enter();
+    for (b = 0; b < TCACHE_BINS; b++)
+        tcache_flush(b, TCACHE_COUNT);
+    arena_exit();
+}
+
+/*
+ * tcache_key_init - Create the key whose destructor flushes caches
+ */
+static void tcache_key_init(void)
+{
+    pthread_key_create(&tcache_key, tcache_exit);
+}
+#endif
+
+/*
+ * mm_init - Initialize the memory manager with empty arenas. With
+ * ARENAS it must be called before other threads use the allocator
+ */
+int mm_init(void)
+{
+    int r;
+#if ARENAS
+    struct arena *self = arena_get();
+    int i;
+
+    for (i = 0; i < ARENAS; i++){
+        cur_arena = &arenas[i];
+        heap_listp = 0; /* Each starts again when next used */
+        cur_arena->remote = NULL;
+    }
+    cur_arena = self;
+#endif
+#if TCACHE_COUNT
+    memset(tcache, 0, sizeof(tcache)); /* Blocks of the old heaps */
+    memset(tcache_count, 0, sizeof(tcache_count));
+#endif
+    arena_enter();
+    r = arena_init();
+    arena_exit();
+    return r;
+}
+
+/* 
+ * malloc - Allocate a block with at least size bytes of payload 
+ */
+void *malloc(size_t size)
+{
+    void *p;
+#if TCACHE_COUNT
+    int b;
+
+    /* A cached block of the right size is taken without locking */
+    if ((b = tcache_bin(size)) >= 0 && (p = tcache[b]) != NULL){
+        tcache[b] = *(void **)p;
+        tcache_count[b]--;
+        return p;
+    }
+#endif
+#if ARENAS
+    arena_get();
+#endif
+    arena_enter();
+    p = arena_malloc(size);
+    arena_exit();
+    return p;
+}
+
+/*
+ * free - Free a block. A block of another arena is handed to it
+ * without taking its lock, a small block of the thread's own arena
+ * goes to the thread's cache
+ */
+void free(void *bp)
+{
+#if ARENAS
+    struct arena *a;
+
+    if (bp == 0)
+        return;
+    if ((a = arena_of(bp)) == NULL){
+        if (IS_MAPPED(bp))
+            unmap_block(bp);
+        return;
+    }
+    if (a != arena_get()){
+        arena_remote_free(a, bp);
+        return;
+    }
+#endif
+#if TCACHE_COUNT
+    int b;
+
+    if ((b = tcache_block_bin(bp)) >= 0){
+        if (!tcache_used){ /* Flush the cache when the thread exits */
+            pthread_once(&tcache_once, tcache_key_init);
+            pthread_setspecific(tcache_key, &tcache_used);
+            tcache_used = 1;
+        }
+        if (tcache_count[b] == TCACHE_COUNT){ /* Full - flush half */
+            arena_enter();
+            tcache_flush(b, TCACHE_COUNT / 2);
+            arena_exit();
+        }
+        *(void **)bp = tcache[b];
+        tcache[b] = bp;
+        tcache_count[b]++;
+        return;
+    }
+#endif
+    arena_enter();
+    arena_free(bp);
+    arena_exit();
+}
+
+/*
+ * realloc - Reallocates size memory. A block of another arena is
+ * resized in that arena, under its lock
+ */
+void *realloc(void *ptr, size_t size)
+{
+    void *p;
+#if ARENAS
+    struct arena *self = arena_get(), *a;
+
+    if (ptr != NULL && (a = arena_of(ptr)) != NULL)
+        cur_arena = a;
+#endif
+    arena_enter();
+    p = arena_realloc(ptr, size);
+    arena_exit();
+#if ARENAS
+    cur_arena = self;
+#endif
+    return p;
+}
+
+/* Calloc - Allocates memory for an array of nmemb 
+ * elements of size bytes
+ * All bytes are initialized to 0
+ */
+void *calloc(size_t nmemb, size_t size){
+
+    void *newptr;
+    size_t num = nmemb * size;
+
+    /* nmemb * size overflows, or is more than a region can hold */
+    if ((nmemb != 0 && num / nmemb != size) || MAP_TOO_BIG(num)){
+        errno = ENOMEM;
+        return NULL;
+    }
+    newptr = malloc(num);
+ 
+    if(!newptr) //if malloc fails
+        return NULL;
+
+    memset(newptr, 0, num);
+    return newptr;
+}
+
+/*
+ * memalign - Allocate a block with at least size bytes of payload that
+ * starts at a multiple of align, a power of two
+ */
+void *memalign(size_t align, size_t size)
+{
+    void *p;
+
+    if (align == 0 || (align & (align - 1))){
+        errno = EINVAL;
+        return NULL;
+    }
+    if (align <= ALIGNMENT)
+        return malloc(size);
+    if (size == 0)
+        return NULL;
+    if (align > ARENA_SIZE){ /* Too far to offset even a mapped block */
+        errno = ENOMEM;
+        return NULL;
+    }
+#if ARENAS
+    arena_get();
+#endif
+    arena_enter();
+    /* A block the heap has no room for gets a region of its own */
+    if ((p = alloc_aligned(align, size)) != NULL ||
+        (p = map_aligned(align, size)) != NULL){
+        STAT_ADD(mallocs, 1);
+        STAT_ADD(requested, size);
+        STAT_ADD(granted, block_size(p));
+    }
+    arena_exit();
+    return p;
+}
+
+/*
+ * posix_memalign - Set *memptr to a block as memalign does; align must
+ * also be a multiple of sizeof(void *)
+ */
+int posix_memalign(void **memptr, size_t align, size_t size)
+{
+    void *p;
+
+    if (align == 0 || align % sizeof(void *) != 0 || (align & (align - 1)))
+        return EINVAL;
+    if ((p = memalign(align, size)) == NULL && size != 0)
+        return ENOMEM;
+    *memptr = p;
+    return 0;
+}
+
+/*
+ * aligned_alloc - C11 name of memalign
+ */
+void *aligned_alloc(size_t align, size_t size)
+{
+    return memalign(align, size);
+}
+
+/*
+ * valloc - Allocate a page aligned block
+ */
+void *valloc(size_t size)
+{
+    return memalign(mem_pagesize(), size);
+}
+
+/*
+ * pvalloc - Allocate a page aligned block of whole pages, one page for
+ * size 0
+ */
+void *pvalloc(size_t size)
+{
+    size_t page = mem_pagesize();
+
+    if (size > SIZE_MAX - page){
+        errno = ENOMEM;
+        return NULL;
+    }
+    return memalign(page, size ? (size + page - 1) & ~(page - 1) : page);
+}
+
+/*
+ * malloc_usable_size - Return how many bytes of payload block p has,
+ * at least as many as were asked for. The headroom of a GROWN block is
+ * not counted, since it can be taken back
+ */
+size_t malloc_usable_size(void *p)
+{
+    size_t n;
+#if ARENAS
+    struct arena *self = arena_get(), *a;
+
+    if (p == NULL)
+        return 0;
+    if ((a = arena_of(p)) == NULL)
+        return IS_MAPPED(p) ? MAPPED_SIZE(p) : 0;
+    cur_arena = a;
+#else
+    if (p == NULL)
+        return 0;
+#endif
+    arena_enter();
+    if (slab_owns(p) || IS_MAPPED(p))
+        n = block_size(p);
+    else
+        n = grow_used_size((char *)p - WSIZE) - WSIZE;
+    arena_exit();
+#if ARENAS
+    cur_arena = self;
+#endif
+    return n;
+}
+
+/*
+ * mm_getstats - Fill in st with the statistics of all arenas in use.
+ * The counters are summed, the blocks of each heap are counted by
+ * walking it under the arena's lock
+ */
+void mm_getstats(struct mm_stats *st)
+{
+    struct mm_stats *as;
+    char *bp;
+    size_t size;
+    int a, c;
+#if ARENAS
+    struct arena *self = arena_get();
+#endif
+
+    memset(st, 0, sizeof(*st));
+    for (c = 0; c < LARGE_CLASS; c++)
+        st->class_size[c] = (size_t)(SC_SUBS + (c & (SC_SUBS - 1))) <<
+            (SC_MIN_LOG - SC_SUB_BITS + (c >> SC_SUB_BITS));
+    st->class_size[LARGE_CLASS] = LARGE_SIZE;
+
+    for (a = 0; a < MAX(ARENAS, 1); a++){
+#if ARENAS
+        cur_arena = &arenas[a];
+#endif
+        arena_enter();
+        if (heap_listp != 0){
+            as = &cur_arena->stats;
+            st->mallocs += as->mallocs;
+            st->frees += as->frees;
+            st->requested += as->requested;
+            st->granted += as->granted;
+            for (c = 0; c < MM_STATS_SEARCH; c++)
+                st->search[c] += as->search[c];
+            st->splits += as->splits;
+            st->coalesces += as->coalesces;
+
+            for (bp = LIST_END + WSIZE; (size = GET_SIZE(bp)) > 0;
+                bp += size){
+                if (GET_ALLOC(bp)){
+                    st->alloc_count++;
+                    st->alloc_bytes += size;
+                }
+                else{
+                    st->free_count[size_class(size)]++;
+                    st->free_bytes[size_class(size)] += size;
+                }
+            }
+#if ARENAS
+            if (a > 0){ /* Arena 0 is counted by memlib */
+                st->heap_size += cur_arena->brk - cur_arena->lo;
+                st->peak_heap += cur_arena->peak;
+            }
+#endif
+        }
+        arena_exit();
+    }
+#if ARENAS
+    cur_arena = self;
+    pthread_mutex_lock(&mem_lock);
+#endif
+    st->heap_size += mem_heapsize();
+    st->peak_heap += mem_peak_heapsize();
+#if ARENAS
+    pthread_mutex_unlock(&mem_lock);
+#endif
+}
+
+/*
+ * mm_heapdump - Write the block layout of each arena's heap to fp as
+ * text: a line "arena <n> <heap bytes>" and then a line for each block
+ * with its offset from the start of the heap, size, state and size
+ * class. The state is a for allocated, f for free and s for a slab;
+ * parked blocks read as allocated. Mapped blocks are not in a heap
+ */
+void mm_heapdump(FILE *fp)
+{
+    char *lo, *bp;
+    size_t size;
+    int a;
+#if ARENAS
+    struct arena *self = arena_get();
+#endif
+
+    for (a = 0; a < MAX(ARENAS, 1); a++){
+#if ARENAS
+        cur_arena = &arenas[a];
+#endif
+        arena_enter();
+        if (heap_listp != 0){
+            lo = HEAP_LO();
+            fprintf(fp, "arena %d %zu\n", a,
+                (size_t)((char *)HEAP_HI() + 1 - lo));
+            for (bp = LIST_END + WSIZE; (size = GET_SIZE(bp)) > 0;
+                bp += size)
+                fprintf(fp, "%zu %zu %c %d\n", (size_t)(bp - lo), size,
+                    !GET_ALLOC(bp) ? 'f' : slab_owns(bp + WSIZE) ? 's' : 'a',
+                    size_class(size));
+        }
+        arena_exit();
+    }
+#if ARENAS
+    cur_arena = self;
+#endif
+}
+
+/*
+ * checkblock - Check alignment of each block, if header and footer
+ *              values of a free block match and if its PREV_ALLOC bit
+ *              agrees with the previous block
+ */
+static void checkblock(void *bp, int prev_alloc) 
+{
+    if ((size_t)(bp + WSIZE) % ALIGNMENT){
+        printf("Error: %p is not %d-byte aligned\n", bp, ALIGNMENT);
+        exit(1);
+    }
+    if (GET_SIZE(HDRP(bp)) < 2*DSIZE){
+        printf("Error: %p is smaller than the minimum block\n", bp);
+        exit(1);
+    }
+    if (!GET_ALLOC(bp) && GET_SIZE(HDRP(bp)) != GET_SIZE(FTRP(bp))){
+        printf("Error: %p header do not match footer\n", bp);
+       exit(1);
+    }
+    if (!GET_PREV_ALLOC(bp) != !prev_alloc){
+        printf("Error: %p previous allocated bit is wrong\n", bp);
+        exit(1);
+    }
+    if (!prev_alloc && !GET_ALLOC(bp)){
+        printf("Error: %p two consecutive free blocks\n", bp);
+        exit(1);
+    }
+}
+
+/*
+ * checkslabs - Check every slab with free slots is marked in slab_map,
+ * is on the list of its slot size and that its free count matches its
+ * bitmap
+ */
+static void checkslabs(void)
+{
+#if SLAB_MAX
+    char *s;
+    int c;
+
+    for (c = 0; c < SLAB_CLASSES; c++){
+        for (s = slab_list[c]; s != NULL; s = GETTL(SLAB_NEXT(s))){
+            if (!slab_owns(s) || GET(SLAB_SLOT(s)) != (unsigned)c * ALIGNMENT){
+                printf("Error: %p - Bad slab in list - %d\n", s, c);
+                exit(1);
+            }
+            if (GET(SLAB_NFREE(s)) == 0 ||
+                GET(SLAB_NFREE(s)) != slab_count_bits(s)){
+                printf("Error: %p - Slab free count is wrong\n", s);
+                exit(1);
+            }
+        }
+    }
+#endif
+}
+
+/*
+ * checkgrow - Check every block with a headroom record is an allocated
+ * block marked GROWN that is larger than it needs, and that ngrown
+ * blocks in the heap are marked GROWN
+ */
+static void checkgrow(int ngrown)
+{
+#if GROW_DIV
+    int i;
+
+    for (i = 0; i < GROW_SLOTS; i++){
+        if (grow_blk[i] == NULL)
+            continue;
+        if (!in_heap(grow_blk[i]) || !GET_ALLOC(HDRP(grow_blk[i])) ||
+            !GET_GROWN(HDRP(grow_blk[i])) ||
+            GET_SIZE(HDRP(grow_blk[i])) < grow_used[i] + 2*DSIZE){
+            printf("Error: %p - Bad headroom record\n", grow_blk[i]);
+            exit(1);
+        }
+        ngrown--;
+    }
+#endif
+    if (ngrown){
+        printf("Error: GROWN blocks and headroom records don't match\n");
+        exit(1);
+    }
+}
+
+/*
+ * checkquick - Check every parked block is an allocated block of the
+ * size of its quick list and that quick_count of them are parked
+ */
+static void checkquick(void)
+{
+#if QUICK_MAX
+    int b, n = 0;
+    char *bp;
+
+    for (b = 0; b < QUICK_BINS; b++){
+        for (bp = quick[b]; bp != NULL; bp = GETTL(NEXT_FBLK_PTR(bp))){
+            if (!in_heap(bp) || !GET_ALLOC(HDRP(bp)) ||
+                GET_GROWN(HDRP(bp)) || (int)QUICK_BIN(GET_SIZE(bp)) != b){
+                printf("Error: %p - Bad block in quick list %d\n", bp, b);
+                exit(1);
+            }
+            n++;
+        }
+    }
+    if (n != quick_count){
+        printf("Error: quick lists hold %d blocks, not %d\n", n, quick_count);
+        exit(1);
+    }
+#endif
+}
+
+/*
+ * checktree - Check the subtree of large free blocks rooted at bp
+ * Checks each node is a free large block in the heap, that children
+ * point back to their parent, that nodes are in (size, address) order
+ * and that no red node has a red child. Decrements the free block count
+ * for each node and returns the black height of the subtree
+ */
+static int checktree(char *bp, int *nfblk)
+{
+    int lh, rh;
+
+    if (bp == NULL)
+        return 1;
+    if (!in_heap(bp) || GET_ALLOC(HDRP(bp)) || GET_SIZE(bp) < LARGE_SIZE){
+        printf("Error: %p - Bad block in large block tree\n", bp);
+        exit(1);
+    }
+    if ((LEFT(bp) && (PARENT(LEFT(bp)) != bp ||
+        !tree_less(LEFT(bp), bp))) ||
+        (RIGHT(bp) && (PARENT(RIGHT(bp)) != bp ||
+        !tree_less(bp, RIGHT(bp))))){
+        printf("Error: %p - Tree children inconsistent\n", bp);
+        exit(1);
+    }
+    if (IS_RED(bp) && (IS_RED(LEFT(bp)) || IS_RED(RIGHT(bp)))){
+        printf("Error: %p - Red tree node has a red child\n", bp);
+        exit(1);
+    }
+    *nfblk -= 1;
+    lh = checktree(LEFT(bp), nfblk);
+    rh = checktree(RIGHT(bp), nfblk);
+    if (lh != rh){
+        printf("Error: %p - Tree black height mismatch\n", bp);
+        exit(1);
+    }
+    return lh + !IS_RED(bp);
+}
+
+/* 
+ * mm_checkheap - Check the heap for correctness.
+ * Check correctness of header
+ * Calls checkblock for all blocks iteratively
+ * Check the epilogue header ends the heap
+ * Check if next and previous pointers are consistent
+ * Check address ordered lists are in order and their hints are in them
+ * Check if the pointers in free list are in_heap
+ * Compare the number of free blocks iteratively and in free list
+ * Check the red-black tree of large free blocks
+ * Check the slabs that have free slots
+ * Check the blocks parked in the quick lists
+ * Check if end marker (0/1) is in place
+ */
+void mm_checkheap(int lineno)  
+{ 
+    void *bp = heap_listp;
+    int x = 0;
+    int nfblk = 0; /* free block counter */
+    int prev_alloc = 1; /* The list end marker is allocated */
+    int ngrown = 0; /* blocks holding realloc headroom */
+
+    /* Check alignment of header */
+    if((GET_SIZE(HDRP(heap_listp)) != PROLOGUE_SIZE) ||
+        !GET_ALLOC(HDRP(heap_listp))){
+        printf("Error - Line: %d Bad prologue header\n", lineno);
+        exit(1);
+    }
+    bp = LIST_END;
+
+    /*Check if end marker is in place */
+    if(GET_SIZE(bp) && !GET_ALLOC(bp)){
+        printf("List end pointer not in place\n");
+        exit(1);
+    }
+    /* Check each block iteratively */
+    for (bp+=WSIZE; GET_SIZE(bp) > 0; bp = NEXT_BLKP(bp)){
+        checkblock(bp, prev_alloc);
+        prev_alloc = GET_ALLOC(bp);
+        /*Count number of free blocks*/
+        if(!GET_ALLOC(bp))
+            nfblk+=1;   
+        if(GET_GROWN(bp))
+            ngrown+=1;
+    }
+
+    /* Check the epilogue is the last word of the heap */
+    if(bp != (char *)HEAP_HI() + 1 - WSIZE || !GET_ALLOC(bp) ||
+        !GET_PREV_ALLOC(bp) != !prev_alloc){
+        printf("Error - Line: %d Bad epilogue header\n", lineno);
+        exit(1);
+    }
+
+    /* Check all the segregated free lists */
+    for(x = 0; x < LARGE_CLASS; x++){
+        /* Check the bitmap agrees with the list being empty or not */
+        if(!(class_map & (1UL << x)) !=
+            (NEXT_FREE_BLOCK(LIST_HEAD(x)) == LIST_END)){
+            printf("Error: class bitmap wrong for list - %d\n", x);
+            exit(1);
+        }
+#if LIST_ORDER == ADDRESS_ORDER
+        if(list_hint[x] != NULL && (!in_heap(list_hint[x]) ||
+            GET_ALLOC(HDRP(list_hint[x])) ||
+            size_class(GET_SIZE(list_hint[x])) != x)){
+            printf("Error: %p - Bad hint for list - %d\n", list_hint[x], x);
+            exit(1);
+        }
+#endif
+        for (bp = NEXT_FREE_BLOCK(LIST_HEAD(x)); GET_SIZE(HDRP(bp)) > 0;
+            bp = NEXT_FREE_BLOCK(bp)){
+
+            /* Check if block is marked as free */
+            if(GET_ALLOC(HDRP(bp))){
+                printf("Error: %p - Block in free list is allocated\n", bp);
+                exit(1);
+            }
             if(!in_heap(NEXT_FREE_BLOCK(bp))){
                 printf("Error: %p - Next block pointer not in heap\n", bp);
                 exit(1);
@@ -391,53 +1785,198 @@ void mm_checkheap(int lineno)
                 exit(1);
             }
 
-            /* Given bp, check if prev pointer of the next block points to it*/
-            /*Ignore if next block is epilogue*/
-            if(GET_SIZE(NEXT_FREE_BLOCK(bp)) > 0){
-                if(bp != PREV_FREE_BLOCK(NEXT_FREE_BLOCK(bp))){
-                    printf("Error: %p Pointer" 
-                        "in next block inconsistent\n", bp);
-                    exit(1);
-                }
-            }
-            /* Given bp, check if next pointer of the prev block points to it*/
-            /*Ignore if prev block is header*/
-            if(PREV_FREE_BLOCK(bp) > (heap_listp + (28*WSIZE)))
-                if(bp != NEXT_FREE_BLOCK(PREV_FREE_BLOCK(bp))){
-                    printf("Error: %p pointer" 
-                        "in previous block inconsistent\n", bp);
-                    exit(1);
-                }
-            nfblk-=1; /*Decrement free count block*/
+            /* Given bp, check if prev pointer of the next block points to it*/
+            /*Ignore if next block is epilogue*/
+            if(GET_SIZE(NEXT_FREE_BLOCK(bp)) > 0){
+                if(bp != PREV_FREE_BLOCK(NEXT_FREE_BLOCK(bp))){
+                    printf("Error: %p Pointer" 
+                        "in next block inconsistent\n", bp);
+                    exit(1);
+                }
+            }
+            /* Given bp, check if next pointer of the prev block points to it*/
+            /*Ignore if prev block is header*/
+            if(PREV_FREE_BLOCK(bp) > LIST_END)
+                if(bp != NEXT_FREE_BLOCK(PREV_FREE_BLOCK(bp))){
+                    printf("Error: %p pointer" 
+                        "in previous block inconsistent\n", bp);
+                    exit(1);
+                }
+#if LIST_ORDER == ADDRESS_ORDER
+            if(GET_SIZE(NEXT_FREE_BLOCK(bp)) > 0 &&
+                NEXT_FREE_BLOCK(bp) < (char *)bp){
+                printf("Error: %p - List %d not in address order\n", bp, x);
+                exit(1);
+            }
+#endif
+            nfblk-=1; /*Decrement free count block*/
+
+            /* Check size of block belong to right list */
+            if(size_class(GET_SIZE(bp)) != x){
+                printf("Incorrect size in list - %d\n",x);
+                exit(1);
+            }
+        }
+    }
+    /* Check the tree of large blocks */
+    if(!(class_map & (1UL << LARGE_CLASS)) != (TREE_ROOT == NULL)){
+        printf("Error: class bitmap wrong for large block tree\n");
+        exit(1);
+    }
+    if(TREE_ROOT != NULL && PARENT(TREE_ROOT) != NULL){
+        printf("Error: %p - Tree root has a parent\n", TREE_ROOT);
+        exit(1);
+    }
+    if(IS_RED(TREE_ROOT)){
+        printf("Error: %p - Tree root is red\n", TREE_ROOT);
+        exit(1);
+    }
+    checktree(TREE_ROOT, &nfblk);
+    checkslabs();
+    checkgrow(ngrown);
+    checkquick();
+
+    /* Check if number of free blocks in heap and free list match*/
+    if(nfblk){
+        printf("Number of free blocks don't match! - %d\n", nfblk);
+        exit(1);
+    }
+}
+
+#if INCR_CHECK
+/*
+ * incr_checkblock - Check block bp the call changed against its
+ * neighbours: its header, the PREV_ALLOC bit of the next block, the
+ * free block before it and, for a free block, its footer, its class bit
+ * and the list pointers to and from its neighbours in the list. A list
+ * header is checked against the first block of its list
+ */
+static void incr_checkblock(char *bp)
+{
+    char *epi = (char *)HEAP_HI() + 1 - WSIZE;
+    char *next, *prev;
+    size_t size;
+
+    if (bp < LIST_END){ /* List header */
+        next = NEXT_FREE_BLOCK(bp);
+        if (next != LIST_END && (GET_ALLOC(next) ||
+            PREV_FREE_BLOCK(next) != bp)){
+            printf("Error: %p - List header inconsistent\n", bp);
+            exit(1);
+        }
+        return;
+    }
+    if (bp == LIST_END || bp >= epi) /* Cut off the end of the heap */
+        return;
+
+    size = GET_SIZE(bp);
+    if ((size_t)(bp + WSIZE) % ALIGNMENT || size < 2*DSIZE ||
+        bp + size > epi){
+        printf("Error: %p - Bad block header\n", bp);
+        exit(1);
+    }
+    next = NEXT_BLKP(bp);
+    if (!GET_PREV_ALLOC(next) != !GET_ALLOC(bp)){
+        printf("Error: %p previous allocated bit is wrong\n", next);
+        exit(1);
+    }
+    if (!GET_PREV_ALLOC(bp)){
+        prev = PREV_BLKP(bp);
+        if (prev <= LIST_END || GET_ALLOC(prev) || NEXT_BLKP(prev) != bp){
+            printf("Error: %p - Block before is not free\n", bp);
+            exit(1);
+        }
+        if (!GET_ALLOC(bp)){
+            printf("Error: %p two consecutive free blocks\n", bp);
+            exit(1);
+        }
+    }
+    if (GET_ALLOC(bp)){
+#if SLAB_MAX
+        char *s = bp + WSIZE;
+
+        if (slab_owns(s) && GET(SLAB_NFREE(s)) != slab_count_bits(s)){
+            printf("Error: %p - Slab free count is wrong\n", s);
+            exit(1);
+        }
+#endif
+        return;
+    }
+
+    if (size != GET_SIZE(FTRP(bp))){
+        printf("Error: %p header do not match footer\n", bp);
+        exit(1);
+    }
+    if (!GET_ALLOC(next)){
+        printf("Error: %p two consecutive free blocks\n", next);
+        exit(1);
+    }
+    if (!(class_map & (1UL << size_class(size)))){
+        printf("Error: %p - Class bit of free block not set\n", bp);
+        exit(1);
+    }
+    if (size >= LARGE_SIZE) /* The tree is checked as a whole */
+        return;
+    next = NEXT_FREE_BLOCK(bp);
+    prev = PREV_FREE_BLOCK(bp);
+    if (!in_heap(next) || !in_heap(prev) || NEXT_FREE_BLOCK(prev) != bp){
+        printf("Error: %p - Previous block pointer inconsistent\n", bp);
+        exit(1);
+    }
+    if (GET_SIZE(next) > 0 && (GET_ALLOC(next) ||
+        PREV_FREE_BLOCK(next) != bp ||
+        size_class(GET_SIZE(next)) != size_class(size))){
+        printf("Error: %p - Next block pointer inconsistent\n", bp);
+        exit(1);
+    }
+}
+
+/*
+ * incr_checkheap - Check the blocks and lists the call changed, then
+ * clear the log. Run by arena_exit after every call
+ */
+static void incr_checkheap(void)
+{
+    char *epi, *root;
+    int nfblk = 0;
+    int i, c;
 
-            /* Check size of block belong to right list */
-            if(x==0){
-                if (GET_SIZE(bp) >= BKT1){
-                    printf("Incorrect size in list - 0\n");
-                    exit(1);
-                }
-            }
-            else if(x==1){                
-                if (GET_SIZE(bp) > BKT2){
-                    printf("Incorrect size in list - 1\n");
-                    exit(1);
-                }
+    if (heap_listp == 0)
+        return;
+    if (cur_arena->incr_n > INCR_LOG) /* Too much changed */
+        mm_checkheap(__LINE__);
+    else{
+        for (i = 0; i < cur_arena->incr_n; i++)
+            if (cur_arena->incr_log[i] != NULL)
+                incr_checkblock(cur_arena->incr_log[i]);
+        epi = (char *)HEAP_HI() + 1 - WSIZE;
+        if (GET_SIZE(epi) != 0 || !GET_ALLOC(epi)){
+            printf("Error: Bad epilogue header\n");
+            exit(1);
+        }
+        /* The bit of each changed list agrees with it being empty */
+        for (c = 0; c < LARGE_CLASS; c++){
+            if ((cur_arena->incr_classes & (1UL << c)) &&
+                !(class_map & (1UL << c)) !=
+                (NEXT_FREE_BLOCK(LIST_HEAD(c)) == LIST_END)){
+                printf("Error: class bitmap wrong for list - %d\n", c);
+                exit(1);
             }
-            else if (x<12) {
-                unsigned int check = x*1000+609;
-                if(GET_SIZE(bp) > check){
-                    printf("Incorrect size in list - %d\n",x);
-                    exit(1);
-                }
+        }
+        if (cur_arena->incr_classes & (1UL << LARGE_CLASS)){
+            root = TREE_ROOT;
+            if (!(class_map & (1UL << LARGE_CLASS)) != (root == NULL) ||
+                (root != NULL && (PARENT(root) != NULL || IS_RED(root)))){
+                printf("Error: Bad large block tree root\n");
+                exit(1);
             }
+            checktree(root, &nfblk);
         }
     }
-    /* Check if number of free blocks in heap and free list match*/
-    if(nfblk){
-        printf("Number of free blocks don't match! - %d\n", nfblk);
-        exit(1);
-    }
+    cur_arena->incr_n = 0;
+    cur_arena->incr_classes = 0;
 }
+#endif
 
 /* 
  * The remaining routines are internal helper routines 
@@ -451,19 +1990,259 @@ inline static void *extend_heap(size_t words){
     char *bp;
     size_t size;
 
-    /* Allocate an even number of words to maintain alignment */
-    size = (words % 2) ? (words+1) * WSIZE : words * WSIZE; 
-    if ((long)(bp = mem_sbrk(size)) == -1)  
+    /* Allocate a multiple of ALIGNMENT to maintain alignment */
+    size = ALIGN(words * WSIZE);
+    if ((long)(bp = heap_sbrk(size)) == -1)  
         return NULL;                                        
 
-    /* Initialize free block header/footer and the epilogue header */
-    PUT(bp, PACK(size, 0));
+    /* The new free block starts at the old epilogue header */
+    bp -= WSIZE;
+    PUT(bp, PACK(size, GET_PREV_ALLOC(bp)));
     PUT(FTRP(bp), PACK(size, 0));
+    PUT(HDRP(NEXT_BLKP(bp)), PACK(0, 1)); /* New epilogue header */
 
     /* Coalesce if the previous block was free */
     return coalesce(bp);                                          
 }
 
+/*
+ * tree_less - Order of large free blocks in the tree: by size, then
+ * by address so that every key is unique
+ */
+inline static int tree_less(const char *a, const char *b){
+    return GET_SIZE(a) < GET_SIZE(b) || (GET_SIZE(a) == GET_SIZE(b) && a < b);
+}
+
+/*
+ * tree_replace - Make new take the place of child old under parent
+ */
+inline static void tree_replace(char *parent, char *old, char *new){
+    if(parent == NULL)
+        PUTTL(TREE_ROOT_PTR, new);
+    else if(LEFT(parent) == old)
+        PUTTL(LEFT_PTR(parent), new);
+    else
+        PUTTL(RIGHT_PTR(parent), new);
+}
+
+/*
+ * rotate_left - Rotate node x down to the left, its right child takes
+ * its place
+ */
+static void rotate_left(char *x){
+    char *y = RIGHT(x);
+
+    PUTTL(RIGHT_PTR(x), LEFT(y));
+    if(LEFT(y) != NULL)
+        PUTTL(PARENT_PTR(LEFT(y)), x);
+    PUTTL(PARENT_PTR(y), PARENT(x));
+    tree_replace(PARENT(x), x, y);
+    PUTTL(LEFT_PTR(y), x);
+    PUTTL(PARENT_PTR(x), y);
+}
+
+/*
+ * rotate_right - Rotate node x down to the right, its left child takes
+ * its place
+ */
+static void rotate_right(char *x){
+    char *y = LEFT(x);
+
+    PUTTL(LEFT_PTR(x), RIGHT(y));
+    if(RIGHT(y) != NULL)
+        PUTTL(PARENT_PTR(RIGHT(y)), x);
+    PUTTL(PARENT_PTR(y), PARENT(x));
+    tree_replace(PARENT(x), x, y);
+    PUTTL(RIGHT_PTR(y), x);
+    PUTTL(PARENT_PTR(x), y);
+}
+
+/*
+ * tree_insert - Insert large free block bp into the red-black tree
+ * and restore the red-black properties on the path to the root
+ */
+static void tree_insert(char *bp){
+    char *parent = NULL;
+    char *n = TREE_ROOT;
+    char *g, *u;
+
+    while(n != NULL){
+        parent = n;
+        n = tree_less(bp, n) ? LEFT(n) : RIGHT(n);
+    }
+    PUTTL(LEFT_PTR(bp), NULL);
+    PUTTL(RIGHT_PTR(bp), NULL);
+    PUTTL(PARENT_PTR(bp), parent);
+    PUT(COLOR_PTR(bp), RED);
+    if(parent == NULL)
+        PUTTL(TREE_ROOT_PTR, bp);
+    else if(tree_less(bp, parent))
+        PUTTL(LEFT_PTR(parent), bp);
+    else
+        PUTTL(RIGHT_PTR(parent), bp);
+
+    /* A red node may not have a red parent */
+    while(IS_RED(parent = PARENT(bp))){
+        g = PARENT(parent); /* Exists since the root is black */
+        if(parent == LEFT(g)){
+            u = RIGHT(g);
+            if(IS_RED(u)){ /* Red uncle - recolor and move up */
+                PUT(COLOR_PTR(parent), BLACK);
+                PUT(COLOR_PTR(u), BLACK);
+                PUT(COLOR_PTR(g), RED);
+                bp = g;
+                continue;
+            }
+            if(bp == RIGHT(parent)){
+                rotate_left(parent);
+                bp = parent;
+                parent = PARENT(bp);
+            }
+            PUT(COLOR_PTR(parent), BLACK);
+            PUT(COLOR_PTR(g), RED);
+            rotate_right(g);
+        }
+        else{
+            u = LEFT(g);
+            if(IS_RED(u)){ /* Red uncle - recolor and move up */
+                PUT(COLOR_PTR(parent), BLACK);
+                PUT(COLOR_PTR(u), BLACK);
+                PUT(COLOR_PTR(g), RED);
+                bp = g;
+                continue;
+            }
+            if(bp == LEFT(parent)){
+                rotate_right(parent);
+                bp = parent;
+                parent = PARENT(bp);
+            }
+            PUT(COLOR_PTR(parent), BLACK);
+            PUT(COLOR_PTR(g), RED);
+            rotate_left(g);
+        }
+    }
+    PUT(COLOR_PTR(TREE_ROOT), BLACK);
+}
+
+/*
+ * tree_delete - Remove large free block bp from the red-black tree
+ * If bp has two children its successor is moved into its place. When a
+ * black node is removed the subtree x that replaced it is one black
+ * short, which is fixed by recoloring and rotations up the tree
+ */
+static void tree_delete(char *bp){
+    char *x, *xp, *y, *w;
+    unsigned int color = COLOR(bp);
+
+    if(LEFT(bp) == NULL || RIGHT(bp) == NULL){
+        x = (LEFT(bp) != NULL) ? LEFT(bp) : RIGHT(bp);
+        xp = PARENT(bp);
+        tree_replace(xp, bp, x);
+        if(x != NULL)
+            PUTTL(PARENT_PTR(x), xp);
+    }
+    else{
+        for(y = RIGHT(bp); LEFT(y) != NULL; y = LEFT(y))
+            ; /* Successor is the leftmost node of the right subtree */
+        color = COLOR(y);
+        x = RIGHT(y);
+        if(PARENT(y) == bp)
+            xp = y;
+        else{
+            xp = PARENT(y);
+            PUTTL(LEFT_PTR(xp), x);
+            if(x != NULL)
+                PUTTL(PARENT_PTR(x), xp);
+            PUTTL(RIGHT_PTR(y), RIGHT(bp));
+            PUTTL(PARENT_PTR(RIGHT(y)), y);
+        }
+        tree_replace(PARENT(bp), bp, y);
+        PUTTL(PARENT_PTR(y), PARENT(bp));
+        PUTTL(LEFT_PTR(y), LEFT(bp));
+        PUTTL(PARENT_PTR(LEFT(y)), y);
+        PUT(COLOR_PTR(y), COLOR(bp));
+    }
+    if(color == RED)
+        return;
+
+    while(x != TREE_ROOT && !IS_RED(x)){
+        if(x == LEFT(xp)){
+            w = RIGHT(xp); /* Sibling exists, it has a black node */
+            if(IS_RED(w)){
+                PUT(COLOR_PTR(w), BLACK);
+                PUT(COLOR_PTR(xp), RED);
+                rotate_left(xp);
+                w = RIGHT(xp);
+            }
+            if(!IS_RED(LEFT(w)) && !IS_RED(RIGHT(w))){
+                PUT(COLOR_PTR(w), RED);
+                x = xp;
+                xp = PARENT(x);
+                continue;
+            }
+            if(!IS_RED(RIGHT(w))){
+                PUT(COLOR_PTR(LEFT(w)), BLACK);
+                PUT(COLOR_PTR(w), RED);
+                rotate_right(w);
+                w = RIGHT(xp);
+            }
+            PUT(COLOR_PTR(w), COLOR(xp));
+            PUT(COLOR_PTR(xp), BLACK);
+            PUT(COLOR_PTR(RIGHT(w)), BLACK);
+            rotate_left(xp);
+        }
+        else{
+            w = LEFT(xp); /* Sibling exists, it has a black node */
+            if(IS_RED(w)){
+                PUT(COLOR_PTR(w), BLACK);
+                PUT(COLOR_PTR(xp), RED);
+                rotate_right(xp);
+                w = LEFT(xp);
+            }
+            if(!IS_RED(LEFT(w)) && !IS_RED(RIGHT(w))){
+                PUT(COLOR_PTR(w), RED);
+                x = xp;
+                xp = PARENT(x);
+                continue;
+            }
+            if(!IS_RED(LEFT(w))){
+                PUT(COLOR_PTR(RIGHT(w)), BLACK);
+                PUT(COLOR_PTR(w), RED);
+                rotate_left(w);
+                w = LEFT(xp);
+            }
+            PUT(COLOR_PTR(w), COLOR(xp));
+            PUT(COLOR_PTR(xp), BLACK);
+            PUT(COLOR_PTR(LEFT(w)), BLACK);
+            rotate_right(xp);
+        }
+        x = TREE_ROOT;
+    }
+    if(x != NULL)
+        PUT(COLOR_PTR(x), BLACK);
+}
+
+/*
+ * tree_fit - Return the smallest large free block of at least asize
+ * bytes, the lowest addressed one among equal sizes, or NULL. Adds the
+ * number of nodes looked at to *seen
+ */
+static void *tree_fit(size_t asize, int *seen){
+    char *best = NULL;
+    char *n = TREE_ROOT;
+
+    while(n != NULL){
+        (*seen)++;
+        if(GET_SIZE(n) >= asize){
+            best = n;
+            n = LEFT(n);
+        }
+        else
+            n = RIGHT(n);
+    }
+    return best;
+}
+
 /*
  * deleteBlock - delete block from list 
  * Update previous and next pointers of
@@ -471,11 +2250,32 @@ inline static void *extend_heap(size_t words){
  */
 
 inline static void deleteBlock(void *bp){
+    if(GET_SIZE(bp) >= LARGE_SIZE){ /* Large blocks are in the tree */
+        INCR_CLASS(LARGE_CLASS);
+        tree_delete(bp);
+        if(TREE_ROOT == NULL)
+            class_map &= ~(1UL << LARGE_CLASS);
+        return;
+    }
+
     char *block_prev = PREV_FREE_BLOCK(bp);
     char *block_next = NEXT_FREE_BLOCK(bp);
     if(!GET_ALLOC(block_next))
         PUTDL(PREV_FBLK_PTR(block_next), block_prev);
     PUTDL(NEXT_FBLK_PTR(block_prev), block_next);
+    INCR_TOUCH(block_prev);
+    INCR_TOUCH(block_next);
+    INCR_CLASS(size_class(GET_SIZE(bp)));
+#if LIST_ORDER == ADDRESS_ORDER
+    /* The hint moves back to the previous block, or to the list head */
+    if(list_hint[size_class(GET_SIZE(bp))] == bp)
+        list_hint[size_class(GET_SIZE(bp))] =
+            (block_prev > LIST_END) ? block_prev : NULL;
+#endif
+
+    /* Clear the class bit if that was the only block in its list */
+    if(block_next == LIST_END && block_prev < LIST_END)
+        class_map &= ~(1UL << size_class(GET_SIZE(bp)));
 }
 
 /*
@@ -483,48 +2283,56 @@ inline static void deleteBlock(void *bp){
  */
 
 inline static void *coalesce(void *bp){
-    size_t next_alloc;
-    char* rptr;
- 
-    if(!in_heap(FTRP(bp)+WSIZE)) //Check if the next free block is in heap
-        next_alloc = (unsigned int)1;
-    else
-        next_alloc = GET_ALLOC(HDRP(NEXT_BLKP(bp)));
-
-    size_t prev_alloc = GET_ALLOC(bp - WSIZE);
+    size_t next_alloc = GET_ALLOC(HDRP(NEXT_BLKP(bp)));
+    size_t prev_alloc = GET_PREV_ALLOC(HDRP(bp));
     size_t size = GET_SIZE(HDRP(bp));
+    /* A RELEASED block stays so when it takes in a block smaller than
+     * RELEASE_SIZE, whose pages are left in use */
+#if RELEASE_SIZE
+    unsigned int keep = (size < RELEASE_SIZE) ? RELEASED : 0;
+#else
+    unsigned int keep = 0;
+#endif
+
+    /* The block before a coalesced free block is always allocated */
     if (prev_alloc && next_alloc) { /* Previous and next block allocated */
-         rptr = enqueueBlock(bp);
+        return enqueueBlock(bp);
     }
     else if(prev_alloc && !next_alloc){ /* If only Next block is free */
         char *nextbp = NEXT_BLKP(bp);
+        keep &= GET(FTRP(nextbp));
         size += GET_SIZE(HDRP(NEXT_BLKP(bp)));
         deleteBlock(nextbp); /* remove next from list */
-        PUT(HDRP(bp), PACK(size, 0));
-        PUT(FTRP(bp), PACK(size,0));
-        /* add new block to enqueue */
-        rptr = enqueueBlock(bp);
+        STAT_ADD(coalesces, 1);
+        INCR_FORGET(nextbp);
+        PUT(HDRP(bp), PACK(size, PREV_ALLOC));
+        PUT(FTRP(bp), PACK(size, keep));
     }
-
     else if (!prev_alloc && next_alloc) { /* If only previous block is free */
-        
+        keep &= GET((char *)bp - WSIZE); /* Footer of the previous block */
         size += GET_SIZE(HDRP(PREV_BLKP(bp)));
         deleteBlock(PREV_BLKP(bp));
-        PUT(FTRP(bp), PACK(size, 0));
-        PUT(HDRP(PREV_BLKP(bp)), PACK(size, 0));
-        rptr = enqueueBlock(PREV_BLKP(bp));
+        STAT_ADD(coalesces, 1);
+        INCR_FORGET(bp);
+        PUT(FTRP(bp), PACK(size, keep));
+        PUT(HDRP(PREV_BLKP(bp)), PACK(size, PREV_ALLOC));
+        bp = PREV_BLKP(bp);
     }
     else {        /* If previous and next block are free */
+        keep &= GET((char *)bp - WSIZE) | GET(FTRP(NEXT_BLKP(bp)));
         size += GET_SIZE(HDRP(PREV_BLKP(bp))) + 
-            GET_SIZE(FTRP(NEXT_BLKP(bp)));
+            GET_SIZE(HDRP(NEXT_BLKP(bp)));
         deleteBlock(NEXT_BLKP(bp));
         deleteBlock(PREV_BLKP(bp));
-        PUT(HDRP(PREV_BLKP(bp)), PACK(size, 0));
-        PUT(FTRP(NEXT_BLKP(bp)), PACK(size, 0));
+        STAT_ADD(coalesces, 2);
+        INCR_FORGET(bp);
+        INCR_FORGET(NEXT_BLKP(bp));
+        PUT(HDRP(PREV_BLKP(bp)), PACK(size, PREV_ALLOC));
+        PUT(FTRP(NEXT_BLKP(bp)), PACK(size, keep));
         bp = PREV_BLKP(bp);
-        rptr = enqueueBlock(bp);
     }
-    return rptr;
+    /* add new block to enqueue */
+    return enqueueBlock(bp);
 }
 
 /* 
@@ -534,69 +2342,478 @@ inline static void *coalesce(void *bp){
 inline static void place(void *bp, size_t asize)
 {
     size_t csize = GET_SIZE(HDRP(bp));   
+    unsigned int released = GET(FTRP(bp)) & RELEASED;
     deleteBlock(bp);
-    if ((csize - asize) >= (3*DSIZE)) { 
-        PUT(HDRP(bp), PACK(asize, 1));
-        PUT(FTRP(bp), PACK(asize, 1));
+    INCR_TOUCH(bp);
+    /* A free block always follows an allocated one */
+    if ((csize - asize) >= (2*DSIZE)) { 
+        STAT_ADD(splits, 1);
+        PUT(HDRP(bp), PACK(asize, 1 | PREV_ALLOC));
         bp = NEXT_BLKP(bp);
-        PUT(HDRP(bp), PACK(csize-asize, 0));
-        PUT(FTRP(bp), PACK(csize-asize, 0));
+        PUT(HDRP(bp), PACK(csize-asize, PREV_ALLOC));
+#if RELEASE_SIZE
+        if (!released && csize - asize >= RELEASE_SIZE){ /* Free the rest */
+            mem_release((char *)bp + FREE_HDR,
+                csize - asize - FREE_HDR - WSIZE);
+            released = RELEASED;
+        }
+#endif
+        PUT(FTRP(bp), PACK(csize-asize, released));
         enqueueBlock(bp);
     }
     else { 
-        PUT(HDRP(bp), PACK(csize, 1));
-        PUT(FTRP(bp), PACK(csize, 1));
+        PUT(HDRP(bp), PACK(csize, 1 | PREV_ALLOC));
+        SET_PREV_ALLOC(HDRP(NEXT_BLKP(bp)));
+    }
+}
+
+/*
+ * scan_list - Return a block of at least asize bytes from the free list
+ * starting at bp, chosen according to FIT_POLICY, or NULL if none fits.
+ * Adds the number of blocks looked at to *seen
+ */
+inline static void *scan_list(char *bp, size_t asize, int *seen)
+{
+    char *best = NULL;
+    int n = 0;
+
+    for (; GET_SIZE(HDRP(bp)) > 0; bp = NEXT_FREE_BLOCK(bp)){
+        (*seen)++;
+        if (asize > GET_SIZE(HDRP(bp)))
+            continue;
+        if (FIT_POLICY != BOUNDED_BEST_FIT || GET_SIZE(HDRP(bp)) == asize)
+            return bp;
+        /* Bounded best-fit - remember the smallest of the candidates */
+        if (best == NULL || GET_SIZE(HDRP(bp)) < GET_SIZE(HDRP(best)))
+            best = bp;
+        if (++n == FIT_CANDIDATES)
+            break;
     }
+    return best;
 }
 
 /* 
  * find_fit - Find a fit for a block with asize bytes
- * update lfree with size of last free block if it is
- * also the last block in allocated memory  
+ * Large sizes are looked up best-fit in the tree. Otherwise the list
+ * of asize's own class is searched first since it can hold
+ * smaller blocks; any block of a higher class fits, so the class bitmap
+ * gives the first non-empty one directly. On a miss lfree is set to the
+ * size of the last block in memory if it is free. The number of free
+ * blocks looked at is counted in the search histogram
  */
 inline static void *find_fit(size_t asize)
 { 
-    /* First-fit search */
     void *bp;
-    char *hp = NULL; /*Pointer to track if last free block on */
-    int i = 0; /* offset for segregated header */
-
-    /* offset to header of segregated list of minimum fitting bucket size */
-    if(asize < BKT1) i = 0;
-    else if (asize < BKT2) i=1;
-    else if (asize < BKT3) i=2;
-    else if (asize < BKT4) i=3;
-    else if (asize < BKT5) i=4;
-    else if (asize < BKT6) i=5;
-    else if (asize < BKT7) i=6;
-    else if (asize < BKT8) i=7;
-    else if (asize < BKT9) i=8;
-    else if (asize < BKT10) i=9;
-    else if (asize < BKT11) i=10;
-    else if (asize < BKT12) i=11;
-    else i = 12;
-
-    for(; i < 13; i++){ /*Check lists iteratively with increasing bucket size*/
-        for (bp = NEXT_FREE_BLOCK(heap_listp + (i * DSIZE)); 
-            GET_SIZE(HDRP(bp)) > 0; bp = NEXT_FREE_BLOCK(bp)){
-            if (!GET_ALLOC(HDRP(bp)) && (asize <= GET_SIZE(HDRP(bp)))){
-                return bp;
-            }
-            hp = bp;
-        }
+    char *epi;
+    int c = size_class(asize);
+    int seen = 0;
+    unsigned long map;
+
+    /* Search the minimum fitting class */
+    if (c == LARGE_CLASS)
+        bp = tree_fit(asize, &seen);
+    else
+        bp = scan_list(NEXT_FREE_BLOCK(LIST_HEAD(c)), asize, &seen);
+
+    /* Search the next non-empty class */
+    map = (c < LARGE_CLASS) ? (class_map & (~0UL << (c + 1))) : 0;
+    if (bp == NULL && map){
+        c = __builtin_ctzl(map);
+        if (c == LARGE_CLASS)
+            bp = tree_fit(asize, &seen);
+        else
+            bp = scan_list(NEXT_FREE_BLOCK(LIST_HEAD(c)), asize, &seen);
+    }
+    /* Buckets 0, 1, 2-3, 4-7, ... and the last for all longer ones */
+    STAT_ADD(search[seen ? MIN(64 - __builtin_clzl(seen),
+        MM_STATS_SEARCH - 1) : 0], 1);
+    if (bp != NULL || map)
+        return bp;
+
+    /* If last free block is last block in memomry */
+    epi = (char *)HEAP_HI() + 1 - WSIZE;
+    if (!GET_PREV_ALLOC(epi))
+        lfree = GET_SIZE(epi - WSIZE);
+    return NULL; /* No fit */
+}
+
+/*
+ * shrink_block - Cut allocated block bp down to asize bytes and free the
+ * tail if it is at least the minimum block size
+ */
+static void shrink_block(char *bp, size_t asize)
+{
+    size_t csize = GET_SIZE(HDRP(bp));
+    char *rem;
+
+    if ((csize - asize) < (2*DSIZE))
+        return;
+    STAT_ADD(splits, 1);
+    INCR_TOUCH(bp);
+    PUT_SHARED(HDRP(bp), PACK(asize, 1 | GET_PREV_ALLOC(HDRP(bp))));
+    rem = NEXT_BLKP(bp);
+    PUT(HDRP(rem), PACK(csize - asize, PREV_ALLOC));
+    PUT(FTRP(rem), PACK(csize - asize, 0));
+    CLEAR_PREV_ALLOC(HDRP(NEXT_BLKP(rem)));
+    coalesce(rem);
+}
+
+/*
+ * trim_block - Give back the memory of free block bp if it is the last
+ * block and at least TRIM_SIZE bytes, by cutting it off the heap
+ */
+inline static void trim_block(char *bp)
+{
+#if TRIM_SIZE
+    size_t size = GET_SIZE(HDRP(bp));
+
+    if (GET_SIZE(HDRP(NEXT_BLKP(bp))) == 0 && size >= TRIM_SIZE){
+        deleteBlock(bp); /* Keep TRIM_PAD bytes of it */
+        PUT(HDRP(bp), PACK(TRIM_PAD, GET_PREV_ALLOC(HDRP(bp))));
+        PUT(FTRP(bp), PACK(TRIM_PAD, 0));
+        PUT(HDRP(NEXT_BLKP(bp)), PACK(0, 1)); /* New epilogue */
+        heap_shrink(size - TRIM_PAD);
+        enqueueBlock(bp);
+    }
+#endif
+}
+
+/*
+ * map_block - Allocate a block of size bytes in a region of its own
+ */
+static void *map_block(size_t size)
+{
+    return map_aligned(MAP_HDR, size);
+}
+
+/*
+ * map_aligned - Allocate a block of size bytes in a region of its own,
+ * its payload at a multiple of align, a power of two from MAP_HDR to
+ * ARENA_SIZE. The payload follows the length of the region from there
+ * on, the offset of that length in the region and the block header
+ */
+static void *map_aligned(size_t align, size_t size)
+{
+    char *m, *p;
+
+    /* Regions start 16-byte aligned, so the payload is at most
+     * align - MAP_HDR bytes further in than it would be unaligned */
+    if (MAP_TOO_BIG(size) ||
+        align - MAP_HDR > SIZE_MAX - MAP_HDR - mem_pagesize() - size){
+        errno = ENOMEM;
+        return NULL;
+    }
+#if ARENAS
+    pthread_mutex_lock(&mem_lock);
+#endif
+    m = mem_map(size + align);
+#if ARENAS
+    pthread_mutex_unlock(&mem_lock);
+#endif
+    if (m == NULL)
+        return NULL;
+    p = (char *)(((size_t)m + MAP_HDR + align - 1) & ~(align - 1));
+    *(size_t *)(p - MAP_HDR) = m + size + align - (p - MAP_HDR);
+    PUT(p - 2*WSIZE, p - MAP_HDR - m);
+    PUT(p - WSIZE, MAPPED);
+    return p;
+}
+
+/*
+ * unmap_block - Free mapped block p by unmapping its region
+ */
+static void unmap_block(void *p)
+{
+#if ARENAS
+    pthread_mutex_lock(&mem_lock);
+#endif
+    mem_unmap((char *)p - MAP_HDR - GET((char *)p - 2*WSIZE));
+#if ARENAS
+    pthread_mutex_unlock(&mem_lock);
+#endif
+}
+
+/*
+ * grow_release - Give back the headroom of the block in grow slot i
+ */
+#if GROW_DIV
+static void grow_release(int i)
+{
+    char *bp = grow_blk[i];
+
+    grow_blk[i] = NULL;
+    CLEAR_GROWN(HDRP(bp));
+    shrink_block(bp, grow_used[i]);
+}
+#endif
+
+/*
+ * grow_track - Record that block bp needs only used bytes and the rest
+ * is headroom. Blocks with less headroom than a minimum block are not
+ * tracked. When every slot is taken the oldest record is evicted and
+ * its block gives its headroom back
+ */
+static void grow_track(char *bp, size_t used)
+{
+#if GROW_DIV
+    int i, slot = -1;
+
+    for (i = 0; i < GROW_SLOTS; i++)
+        if (grow_blk[i] == bp)
+            slot = i;
+    /* No headroom left, or small enough for tcache_block_bin to read */
+    if (GET_SIZE(HDRP(bp)) - used < 2*DSIZE ||
+        (TCACHE_COUNT && GET_SIZE(HDRP(bp)) <= TCACHE_MAX)){
+        if (slot >= 0)
+            grow_blk[slot] = NULL;
+        CLEAR_GROWN(HDRP(bp));
+        return;
+    }
+    if (slot < 0){
+        slot = grow_next;
+        grow_next = (grow_next + 1) % GROW_SLOTS;
+        if (grow_blk[slot] != NULL)
+            grow_release(slot);
     }
-    if((hp != NULL)){
-        bp = NEXT_BLKP(hp);
-        if(!in_heap(bp)){ /* If last free block is last block in memomry */
-            lfree = GET_SIZE(hp);
+    grow_blk[slot] = bp;
+    grow_used[slot] = used;
+    SET_GROWN(HDRP(bp));
+#endif
+}
+
+/*
+ * grow_forget - Drop the record of block bp, which is being freed
+ */
+static void grow_forget(char *bp)
+{
+#if GROW_DIV
+    int i;
+
+    for (i = 0; i < GROW_SLOTS; i++)
+        if (grow_blk[i] == bp)
+            grow_blk[i] = NULL;
+#endif
+}
+
+/*
+ * grow_used_size - Return the size block bp needs: its size less the
+ * headroom recorded for it
+ */
+static size_t grow_used_size(char *bp)
+{
+#if GROW_DIV
+    int i;
+
+    if (GET_GROWN(HDRP(bp)))
+        for (i = 0; i < GROW_SLOTS; i++)
+            if (grow_blk[i] == bp)
+                return grow_used[i];
+#endif
+    return GET_SIZE(HDRP(bp));
+}
+
+/*
+ * grow_reclaim - Give back the headroom of every tracked block and
+ * return how many blocks gave some back
+ */
+static int grow_reclaim(void)
+{
+    int n = 0;
+#if GROW_DIV
+    int i;
+
+    for (i = 0; i < GROW_SLOTS; i++)
+        if (grow_blk[i] != NULL){
+            grow_release(i);
+            n++;
         }
+#endif
+    return n;
+}
+
+/*
+ * alloc_aligned - Allocate size bytes whose payload starts at a multiple
+ * of align, a power of two, from the heap of the arena in use. Enough is
+ * allocated to leave room for a free block in front of the aligned
+ * payload; the front and any unused tail are given back to the free lists
+ */
+static void *alloc_aligned(size_t align, size_t size)
+{
+    char *p, *bp, *nbp;
+    size_t front, csize;
+
+    if (align <= ALIGNMENT)
+        return heap_malloc(size);
+    if (heap_listp == 0 && arena_init() < 0)
+        return NULL;
+    if (size > ARENA_SIZE || (p = heap_alloc(size + align + 2*DSIZE)) == NULL)
+        return NULL;
+    if (((size_t)p & (align - 1)) == 0)
+        nbp = p - WSIZE;
+    else /* First aligned payload leaving a minimum block in front */
+        nbp = (char *)(((size_t)p + 2*DSIZE + align - 1) & ~(align - 1)) -
+            WSIZE;
+
+    bp = p - WSIZE;
+    front = nbp - bp;
+    if (front > 0){ /* Free the front, the aligned block follows it */
+        csize = GET_SIZE(HDRP(bp));
+        PUT(HDRP(bp), PACK(front, GET_PREV_ALLOC(HDRP(bp))));
+        PUT(FTRP(bp), PACK(front, 0));
+        PUT(HDRP(nbp), PACK(csize - front, 1));
+        INCR_TOUCH(nbp);
+        coalesce(bp);
     }
-    return NULL; /* No fit */
+    shrink_block(nbp, MAX(2*DSIZE, ALIGN(size + WSIZE)));
+    return nbp + WSIZE;
+}
+
+/*
+ * slab_owns - Return whether p points into a slab
+ */
+inline static int slab_owns(const void *p)
+{
+#if SLAB_MAX
+    size_t i = SLAB_INDEX(p);
+
+    /* Read without the lock by free, while the arena's other threads
+     * may add or remove slabs of the same slab_map word */
+    return (char *)p >= heap_listp && i < ARENA_SIZE / SLAB_SIZE &&
+        (__atomic_load_n(&slab_map[i / 64], __ATOMIC_RELAXED) >> (i % 64)) & 1;
+#else
+    return 0;
+#endif
+}
+
+#if SLAB_MAX
+/*
+ * slab_count_bits - Return the number of free slots in the bitmap of s
+ */
+static unsigned int slab_count_bits(char *s)
+{
+    unsigned int n = 0;
+    int w;
+
+    for (w = 0; w < SLAB_WORDS; w++)
+        n += __builtin_popcountl(SLAB_BITS(s)[w]);
+    return n;
+}
+
+/*
+ * slab_unlink - Remove slab s from the list of slabs with free slots
+ */
+inline static void slab_unlink(char *s, int c)
+{
+    char *next = GETTL(SLAB_NEXT(s));
+    char *prev = GETTL(SLAB_PREV(s));
+
+    if (prev != NULL)
+        PUTTL(SLAB_NEXT(prev), next);
+    else
+        slab_list[c] = next;
+    if (next != NULL)
+        PUTTL(SLAB_PREV(next), prev);
+}
+
+/*
+ * slab_push - Put slab s at the front of the list of slabs with free slots
+ */
+inline static void slab_push(char *s, int c)
+{
+    PUTTL(SLAB_NEXT(s), slab_list[c]);
+    PUTTL(SLAB_PREV(s), NULL);
+    if (slab_list[c] != NULL)
+        PUTTL(SLAB_PREV(slab_list[c]), s);
+    slab_list[c] = s;
+}
+
+/*
+ * slab_new - Allocate a slab for slots of size slot and mark its frame
+ * in slab_map. All slots start free
+ */
+static char *slab_new(size_t slot)
+{
+    char *s;
+    size_t i, w, n = (SLAB_SIZE - SLAB_HDR) / slot;
+
+    if ((s = alloc_aligned(SLAB_SIZE, SLAB_SIZE)) == NULL)
+        return NULL;
+    PUT(SLAB_SLOT(s), slot);
+    PUT(SLAB_NFREE(s), n);
+    for (w = 0; w < SLAB_WORDS; w++)
+        SLAB_BITS(s)[w] = (n >= 64 * (w + 1)) ? ~0UL :
+            (n > 64 * w) ? (1UL << (n - 64 * w)) - 1 : 0;
+    i = SLAB_INDEX(s);
+    __atomic_store_n(&slab_map[i / 64], slab_map[i / 64] | 1UL << (i % 64),
+        __ATOMIC_RELAXED);
+    slab_map_hi = MAX(slab_map_hi, i / 64);
+    slab_push(s, slot / ALIGNMENT);
+    return s;
+}
+#endif
+
+/*
+ * slab_alloc - Return a free slot of the smallest slot size that holds
+ * size bytes, taking a new slab if no slab of that size has a free slot
+ */
+static void *slab_alloc(size_t size)
+{
+#if SLAB_MAX
+    size_t slot = ALIGN(size);
+    int c = slot / ALIGNMENT;
+    char *s = slab_list[c];
+    unsigned long *bits;
+    int w, i;
+
+    if (s == NULL && (s = slab_new(slot)) == NULL)
+        return NULL;
+    bits = SLAB_BITS(s);
+    for (w = 0; bits[w] == 0; w++) /* A listed slab has a free slot */
+        ;
+    i = __builtin_ctzl(bits[w]);
+    bits[w] &= bits[w] - 1; /* Clear lowest set bit */
+    PUT(SLAB_NFREE(s), GET(SLAB_NFREE(s)) - 1);
+    if (GET(SLAB_NFREE(s)) == 0) /* Slab is full */
+        slab_unlink(s, c);
+    INCR_TOUCH(s - WSIZE);
+    return SLAB_DATA(s) + (w * 64 + i) * slot;
+#else
+    return NULL;
+#endif
+}
+
+/*
+ * slab_free - Mark slot p free in its slab. A slab that becomes empty
+ * is freed, unless it is the only one of its size with free slots
+ */
+static void slab_free(void *p)
+{
+#if SLAB_MAX
+    char *s = SLAB_BASE(p);
+    size_t slot = GET(SLAB_SLOT(s));
+    int c = slot / ALIGNMENT;
+    size_t i = ((char *)p - SLAB_DATA(s)) / slot;
+    size_t nfree = GET(SLAB_NFREE(s)) + 1;
+
+    INCR_TOUCH(s - WSIZE);
+    SLAB_BITS(s)[i / 64] |= 1UL << (i % 64);
+    PUT(SLAB_NFREE(s), nfree);
+    if (nfree == 1) /* Slab was full */
+        slab_push(s, c);
+    else if (nfree == (SLAB_SIZE - SLAB_HDR) / slot &&
+        (slab_list[c] != s || GETTL(SLAB_NEXT(s)) != NULL)){
+        slab_unlink(s, c);
+        i = SLAB_INDEX(s);
+        __atomic_store_n(&slab_map[i / 64], slab_map[i / 64] &
+            ~(1UL << (i % 64)), __ATOMIC_RELAXED);
+        free_block(s - WSIZE);
+    }
+#endif
 }
 
 /*
 * Return whether the pointer is in the heap
 */
 inline static int in_heap(const void *p) {
-    return p <= mem_heap_hi() && p >= mem_heap_lo();
+    return p <= HEAP_HI() && p >= HEAP_LO();
 }
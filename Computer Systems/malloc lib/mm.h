@@ -7,6 +7,12 @@ extern void *mm_malloc (size_t size);
 extern void mm_free (void *ptr);
 extern void *mm_realloc(void *ptr, size_t size);
 extern void *mm_calloc (size_t nmemb, size_t size);
+extern void *mm_memalign(size_t align, size_t size);
+extern int mm_posix_memalign(void **memptr, size_t align, size_t size);
+extern void *mm_aligned_alloc(size_t align, size_t size);
+extern void *mm_valloc(size_t size);
+extern void *mm_pvalloc(size_t size);
+extern size_t mm_malloc_usable_size(void *ptr);
 
 #else
 
@@ -15,6 +21,12 @@ extern void *malloc (size_t size);
 extern void free (void *ptr);
 extern void *realloc(void *ptr, size_t size);
 extern void *calloc (size_t nmemb, size_t size);
+extern void *memalign(size_t align, size_t size);
+extern int posix_memalign(void **memptr, size_t align, size_t size);
+extern void *aligned_alloc(size_t align, size_t size);
+extern void *valloc(size_t size);
+extern void *pvalloc(size_t size);
+extern size_t malloc_usable_size(void *ptr);
 
 #endif
 
@@ -22,3 +34,33 @@ extern int mm_init(void);
 
 /* This is largely for debugging. */
 extern void mm_checkheap(int lineno);
+
+/* Allocator statistics, filled in by mm_getstats(). The counters cover
+ * the calls that reached the heap since mm_init(); the block counts are
+ * taken from the heap as it is. Slabs and blocks parked in quick lists
+ * or thread caches count as allocated */
+#define MM_STATS_CLASSES 41 /* Size classes of the free lists */
+#define MM_STATS_SEARCH  8  /* Search length buckets */
+
+struct mm_stats {
+    size_t heap_size;   /* Bytes of heap, mapped blocks included */
+    size_t peak_heap;   /* Largest heap_size so far */
+    size_t class_size[MM_STATS_CLASSES]; /* Smallest block of each class */
+    size_t free_count[MM_STATS_CLASSES]; /* Free blocks in each class */
+    size_t free_bytes[MM_STATS_CLASSES]; /* Bytes of those blocks */
+    size_t alloc_count; /* Allocated heap blocks */
+    size_t alloc_bytes; /* Bytes of allocated heap blocks */
+    size_t mallocs;     /* malloc calls, realloc copies included */
+    size_t frees;       /* free calls, realloc copies included */
+    size_t requested;   /* Bytes asked for by the malloc calls */
+    size_t granted;     /* Bytes of the blocks they were given */
+    size_t search[MM_STATS_SEARCH]; /* Fit searches by free blocks looked
+                                       at: 0, 1, 2-3, 4-7, ..., 64 and up */
+    size_t splits;      /* Free blocks split by an allocation */
+    size_t coalesces;   /* Free neighbours merged into a freed block */
+};
+
+extern void mm_getstats(struct mm_stats *st);
+
+/* Write the block layout of the heap to fp, for the heapmap tool */
+extern void mm_heapdump(FILE *fp);
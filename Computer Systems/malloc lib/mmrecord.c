@@ -0,0 +1,288 @@
+/*
+ * mmrecord.c - Record the allocator calls of a program, to be turned
+ * into an mdriver trace by rec2rep.
+ *
+ * Loaded with LD_PRELOAD, it interposes on malloc, calloc, realloc, free
+ * and the aligned allocations, passes each call on to the next
+ * definition (normally libc's) and appends a rec_t to a buffer of the
+ * process. The buffer is written out with write(2) when it fills up and
+ * when the program exits, to the file named by MMRECORD_FILE with the
+ * process id appended, or mmrecord.<pid>.log. A child made by fork or a
+ * program it runs starts a log of its own.
+ *
+ *     unix> LD_PRELOAD=$PWD/mmrecord.so MMRECORD_FILE=/tmp/ls ls -l
+ *     unix> ./rec2rep -o ls.rep /tmp/ls.<pid>
+ *
+ * Calls are recorded under a lock held across the call itself, so the
+ * log of a threaded program has them in an order they could have
+ * happened in.
+ */
+#define _GNU_SOURCE
+
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "record.h"
+
+#define REC_BUFSIZE 8192 /* records buffered before a write */
+#define BOOT_SIZE   4096 /* bytes for allocations made by dlsym */
+
+/* The definitions interposed on */
+static void *(*real_malloc)(size_t size);
+static void *(*real_calloc)(size_t nmemb, size_t size);
+static void *(*real_realloc)(void *ptr, size_t size);
+static void (*real_free)(void *ptr);
+static void *(*real_memalign)(size_t align, size_t size);
+static int (*real_posix_memalign)(void **p, size_t align, size_t size);
+static void *(*real_aligned_alloc)(size_t align, size_t size);
+
+static rec_t buf[REC_BUFSIZE];
+static int nbuf;
+static int fd = -1;              /* log file, opened by the first write */
+static int exiting;              /* write each record once exit began */
+static volatile int lock;        /* spin lock around calls and records */
+static int initializing;
+
+/* dlsym may allocate before the real functions are known */
+static char boot[BOOT_SIZE] __attribute__((aligned(16)));
+static size_t boot_used;
+
+#define IN_BOOT(p) ((char *)(p) >= boot && (char *)(p) < boot + BOOT_SIZE)
+
+/*
+ * rec_init - Look up the definitions interposed on
+ */
+static void rec_init(void)
+{
+    initializing = 1;
+    real_malloc = dlsym(RTLD_NEXT, "malloc");
+    real_calloc = dlsym(RTLD_NEXT, "calloc");
+    real_realloc = dlsym(RTLD_NEXT, "realloc");
+    real_free = dlsym(RTLD_NEXT, "free");
+    real_memalign = dlsym(RTLD_NEXT, "memalign");
+    real_posix_memalign = dlsym(RTLD_NEXT, "posix_memalign");
+    real_aligned_alloc = dlsym(RTLD_NEXT, "aligned_alloc");
+    initializing = 0;
+}
+
+/*
+ * boot_alloc - Allocate size zeroed bytes from the bootstrap buffer
+ */
+static void *boot_alloc(size_t size)
+{
+    char *p = boot + boot_used;
+
+    size = (size + 15) & ~(size_t)15;
+    if (size > BOOT_SIZE - boot_used)
+        return NULL;
+    boot_used += size;
+    return p;
+}
+
+/*
+ * rec_lock - Take the lock, spinning a while then yielding the processor
+ *     until it is free
+ */
+static void rec_lock(void)
+{
+    int spins = 0;
+
+    while (__sync_lock_test_and_set(&lock, 1))
+        while (lock)
+            if (++spins % 100 == 0)
+                sched_yield();
+}
+
+/*
+ * rec_unlock - Release the lock
+ */
+static void rec_unlock(void)
+{
+    __sync_lock_release(&lock);
+}
+
+/*
+ * rec_flush - Write the buffered records to the log of the process,
+ *     opening it first if need be
+ */
+static void rec_flush(void)
+{
+    char name[256];
+    const char *base = getenv("MMRECORD_FILE");
+    size_t len = nbuf * sizeof(rec_t), done = 0;
+    ssize_t n;
+
+    if (nbuf == 0)
+        return;
+    if (fd < 0) {
+        if (base)
+            snprintf(name, sizeof(name), "%s.%d", base, (int)getpid());
+        else
+            snprintf(name, sizeof(name), "mmrecord.%d.log", (int)getpid());
+        if ((fd = open(name, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+            0644)) < 0) {
+            nbuf = 0; /* Nowhere to put them */
+            return;
+        }
+    }
+    while (done < len && (n = write(fd, (char *)buf + done, len - done)) > 0)
+        done += n;
+    nbuf = 0;
+}
+
+/*
+ * rec_add - Record a call; called with the lock held
+ */
+static void rec_add(void *ptr, void *old, size_t size, int type)
+{
+    buf[nbuf].ptr = (unsigned long)ptr;
+    buf[nbuf].old = (unsigned long)old;
+    buf[nbuf].info = REC_INFO(size, type);
+    if (++nbuf == REC_BUFSIZE || exiting)
+        rec_flush();
+}
+
+/*
+ * rec_child - Start the log of a child made by fork afresh; the lock was
+ *     taken by the parent around the fork
+ */
+static void rec_child(void)
+{
+    nbuf = 0;
+    if (fd >= 0)
+        close(fd);
+    fd = -1;
+    rec_unlock();
+}
+
+/*
+ * rec_start - Set up the recorder when the program starts
+ */
+static void __attribute__((constructor)) rec_start(void)
+{
+    if (real_malloc == NULL)
+        rec_init();
+    pthread_atfork(rec_lock, rec_unlock, rec_child);
+}
+
+/*
+ * rec_exit - Write out the rest of the log when the program exits
+ */
+static void __attribute__((destructor)) rec_exit(void)
+{
+    rec_lock();
+    rec_flush();
+    exiting = 1;
+    rec_unlock();
+}
+
+void *malloc(size_t size)
+{
+    void *p;
+
+    if (real_malloc == NULL) {
+        if (initializing)
+            return boot_alloc(size);
+        rec_init();
+    }
+    rec_lock();
+    if ((p = real_malloc(size)) != NULL)
+        rec_add(p, NULL, size, REC_MALLOC);
+    rec_unlock();
+    return p;
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+    void *p;
+
+    if (real_calloc == NULL) {
+        if (initializing)
+            return (nmemb && size > BOOT_SIZE / nmemb) ? NULL :
+                boot_alloc(nmemb * size);
+        rec_init();
+    }
+    rec_lock();
+    if ((p = real_calloc(nmemb, size)) != NULL)
+        rec_add(p, NULL, nmemb * size, REC_MALLOC);
+    rec_unlock();
+    return p;
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    void *p;
+
+    if (real_realloc == NULL)
+        rec_init();
+    if (IN_BOOT(ptr)) { /* Move it out of the bootstrap buffer */
+        size_t left = boot + BOOT_SIZE - (char *)ptr;
+
+        if ((p = malloc(size)) != NULL)
+            memcpy(p, ptr, (size < left) ? size : left);
+        return p;
+    }
+    rec_lock();
+    p = real_realloc(ptr, size);
+    if (p != NULL || size == 0)
+        rec_add(p, ptr, size, REC_REALLOC);
+    rec_unlock();
+    return p;
+}
+
+void free(void *ptr)
+{
+    if (ptr == NULL || IN_BOOT(ptr))
+        return;
+    if (real_free == NULL)
+        rec_init();
+    rec_lock();
+    real_free(ptr);
+    rec_add(ptr, NULL, 0, REC_FREE);
+    rec_unlock();
+}
+
+void *memalign(size_t align, size_t size)
+{
+    void *p;
+
+    if (real_memalign == NULL)
+        rec_init();
+    rec_lock();
+    if ((p = real_memalign(align, size)) != NULL)
+        rec_add(p, NULL, size, REC_MALLOC);
+    rec_unlock();
+    return p;
+}
+
+int posix_memalign(void **pp, size_t align, size_t size)
+{
+    int err;
+
+    if (real_posix_memalign == NULL)
+        rec_init();
+    rec_lock();
+    if ((err = real_posix_memalign(pp, align, size)) == 0)
+        rec_add(*pp, NULL, size, REC_MALLOC);
+    rec_unlock();
+    return err;
+}
+
+void *aligned_alloc(size_t align, size_t size)
+{
+    void *p;
+
+    if (real_aligned_alloc == NULL)
+        rec_init();
+    rec_lock();
+    if ((p = real_aligned_alloc(align, size)) != NULL)
+        rec_add(p, NULL, size, REC_MALLOC);
+    rec_unlock();
+    return p;
+}
@@ -0,0 +1,390 @@
+/*
+ * mmstress.c - Threaded stress test of the allocator of the process,
+ * which "make stress" runs with libmm.so preloaded.
+ *
+ * Each thread keeps a table of blocks that it allocates, reallocates,
+ * frees and hands to other threads at random. Every block is filled
+ * with a pattern of its own, which is checked before the block is
+ * reallocated or freed, so a block given to two callers, or data lost
+ * by realloc, shows up as a corrupt block. Blocks handed to another
+ * thread are checked there and freed or reallocated by that thread,
+ * which in libmm.so takes the remote free and foreign realloc paths.
+ * Requests are mostly small, for the thread caches and slabs, with some
+ * large enough to be mapped, and come from malloc, calloc, realloc and
+ * the aligned allocators. One thread forks part way through and the
+ * child allocates too, to check no lock is left held across fork.
+ */
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <malloc.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+
+#define NSLOTS     512      /* blocks held by each thread */
+#define DRAIN_FREQ 64       /* requests between inbox checks */
+#define MAX_THREADS 256
+
+/* A block and the pattern it holds */
+typedef struct {
+    unsigned char *p;
+    size_t size;
+    unsigned int tag;       /* seeds the pattern */
+} blk_t;
+
+/* A block handed to another thread */
+typedef struct msg {
+    struct msg *next;
+    blk_t b;
+} msg_t;
+
+/* State of one thread */
+typedef struct {
+    pthread_t tid;
+    int id;
+    unsigned long rng;      /* xorshift64* state */
+    blk_t slot[NSLOTS];
+    pthread_mutex_t lock;   /* guards inbox */
+    msg_t *inbox;           /* blocks other threads handed over */
+    long handed;            /* blocks handed to other threads */
+} worker_t;
+
+static worker_t workers[MAX_THREADS];
+static int nthreads = 8;
+static long nops = 100000;  /* requests of each thread */
+static size_t min_align = 16; /* alignment every block must have */
+static pthread_barrier_t done;
+
+/*
+ * usage - Explain the command line arguments
+ */
+static void usage(void)
+{
+    fprintf(stderr, "Usage: mmstress [-h] [-t <threads>] [-n <requests>] "
+            "[-a <align>] [-S <seed>]\n");
+    fprintf(stderr, "Options\n");
+    fprintf(stderr, "\t-h         Print this message.\n");
+    fprintf(stderr, "\t-t <n>     Run n threads (default 8).\n");
+    fprintf(stderr, "\t-n <n>     Make n requests in each thread (default 100000).\n");
+    fprintf(stderr, "\t-a <align> Check every block is aligned to align bytes\n"
+            "\t           (default 16).\n");
+    fprintf(stderr, "\t-S <seed>  Seed of the random numbers (default 1).\n");
+}
+
+/*
+ * fail - Report a failed check and stop the test
+ */
+static void fail(const worker_t *w, const char *what, const blk_t *b)
+{
+    fprintf(stderr, "mmstress: thread %d: %s, block %p of %zu bytes\n",
+            w->id, what, (void *)b->p, b->size);
+    exit(1);
+}
+
+/*
+ * rng - Return a random number
+ */
+static unsigned long rng(worker_t *w)
+{
+    w->rng ^= w->rng >> 12;
+    w->rng ^= w->rng << 25;
+    w->rng ^= w->rng >> 27;
+    return w->rng * 0x2545f4914f6cdd1dUL;
+}
+
+/*
+ * draw_size - Draw a request size: mostly small, a few up to a megabyte
+ */
+static size_t draw_size(worker_t *w)
+{
+    unsigned long r = rng(w);
+
+    switch (r % 1000) {
+    case 0:
+        return 128 * 1024 + (r >> 10) % (896 * 1024);
+    case 1 ... 49:
+        return 4096 + (r >> 10) % (60 * 1024);
+    case 50 ... 299:
+        return 129 + (r >> 10) % (4096 - 129);
+    default:
+        return 1 + (r >> 10) % 128;
+    }
+}
+
+/*
+ * fill - Write the pattern of b into it
+ */
+static void fill(blk_t *b)
+{
+    size_t i;
+
+    for (i = 0; i < b->size; i++)
+        b->p[i] = (unsigned char)(b->tag + i * 7);
+}
+
+/*
+ * check - Check the first n bytes of b hold its pattern
+ */
+static void check(const worker_t *w, const blk_t *b, size_t n)
+{
+    size_t i;
+
+    for (i = 0; i < n; i++)
+        if (b->p[i] != (unsigned char)(b->tag + i * 7))
+            fail(w, "corrupt data", b);
+}
+
+/*
+ * new_block - Allocate a block into b with one of the allocation calls
+ */
+static void new_block(worker_t *w, blk_t *b)
+{
+    unsigned long r = rng(w);
+    size_t i, align = (size_t)16 << ((r >> 8) % 9); /* 16 to 4096 */
+    void *p = NULL;
+
+    b->size = draw_size(w);
+    b->tag = (unsigned int)(r >> 32);
+    switch (r % 10) {
+    case 0:
+    case 1:
+        if ((b->p = calloc(1, b->size)) == NULL)
+            fail(w, "calloc failed", b);
+        for (i = 0; i < b->size; i++)
+            if (b->p[i] != 0)
+                fail(w, "calloc block not zeroed", b);
+        break;
+    case 2:
+        if (posix_memalign(&p, align, b->size) != 0)
+            fail(w, "posix_memalign failed", b);
+        b->p = p;
+        break;
+    case 3:
+        b->p = (r & 0x10000) ? aligned_alloc(align, b->size) :
+            memalign(align, b->size);
+        break;
+    case 4:
+        b->p = realloc(NULL, b->size);
+        break;
+    default:
+        b->p = malloc(b->size);
+    }
+    if (b->p == NULL)
+        fail(w, "allocation failed", b);
+    if ((r % 10 == 2 || r % 10 == 3) && (uintptr_t)b->p % align)
+        fail(w, "block not aligned as asked", b);
+    if ((uintptr_t)b->p % min_align)
+        fail(w, "block not aligned", b);
+    fill(b);
+}
+
+/*
+ * resize - Reallocate b to a new size, checking realloc kept the data
+ */
+static void resize(worker_t *w, blk_t *b)
+{
+    size_t size = draw_size(w);
+    unsigned char *p;
+
+    check(w, b, b->size);
+    if ((p = realloc(b->p, size)) == NULL)
+        fail(w, "realloc failed", b);
+    b->p = p;
+    if ((uintptr_t)b->p % min_align)
+        fail(w, "realloc block not aligned", b);
+    check(w, b, size < b->size ? size : b->size);
+    b->size = size;
+    fill(b);
+}
+
+/*
+ * drop - Check b and free it
+ */
+static void drop(worker_t *w, blk_t *b)
+{
+    check(w, b, b->size);
+    free(b->p);
+    b->p = NULL;
+}
+
+/*
+ * hand_over - Give b to a random other thread, which checks and frees it
+ */
+static void hand_over(worker_t *w, blk_t *b)
+{
+    worker_t *to = &workers[(w->id + 1 + rng(w) % (nthreads - 1)) % nthreads];
+    msg_t *m;
+
+    if ((m = malloc(sizeof(*m))) == NULL)
+        fail(w, "malloc of a message failed", b);
+    m->b = *b;
+    pthread_mutex_lock(&to->lock);
+    m->next = to->inbox;
+    to->inbox = m;
+    pthread_mutex_unlock(&to->lock);
+    b->p = NULL;
+    w->handed++;
+}
+
+/*
+ * drain - Take the blocks handed to this thread: each is checked, then
+ * kept in a free slot, reallocated and freed, or just freed
+ */
+static void drain(worker_t *w)
+{
+    msg_t *m, *next;
+    blk_t *b;
+
+    pthread_mutex_lock(&w->lock);
+    m = w->inbox;
+    w->inbox = NULL;
+    pthread_mutex_unlock(&w->lock);
+    for (; m != NULL; m = next) {
+        next = m->next;
+        b = &w->slot[rng(w) % NSLOTS];
+        if (b->p == NULL) {
+            *b = m->b;
+            check(w, b, b->size);
+        } else if (rng(w) & 1) {
+            resize(w, &m->b);
+            drop(w, &m->b);
+        } else
+            drop(w, &m->b);
+        free(m);
+    }
+}
+
+/*
+ * fork_check - Fork and allocate in the child while the other threads
+ * run, then make sure the child got through
+ */
+static void fork_check(worker_t *w)
+{
+    blk_t b = { NULL, 0, 0 };
+    int i, status;
+    pid_t pid;
+
+    if ((pid = fork()) < 0)
+        fail(w, "fork failed", &b);
+    if (pid == 0) {
+        for (i = 0; i < 1000; i++) {
+            new_block(w, &b);
+            drop(w, &b);
+        }
+        _exit(0);
+    }
+    if (waitpid(pid, &status, 0) != pid || !WIFEXITED(status) ||
+        WEXITSTATUS(status) != 0)
+        fail(w, "child of fork failed", &b);
+}
+
+/*
+ * run - Thread body: make nops random requests, then free everything
+ */
+static void *run(void *arg)
+{
+    worker_t *w = arg;
+    blk_t *b;
+    long i;
+    int s;
+
+    for (i = 0; i < nops; i++) {
+        if (i % DRAIN_FREQ == 0)
+            drain(w);
+        if (w->id == 0 && i == nops / 2)
+            fork_check(w);
+        b = &w->slot[rng(w) % NSLOTS];
+        if (b->p == NULL) {
+            new_block(w, b);
+            continue;
+        }
+        switch (rng(w) % 20) {
+        case 0 ... 8:
+            drop(w, b);
+            break;
+        case 9 ... 13:
+            resize(w, b);
+            break;
+        case 14 ... 18:
+            if (nthreads > 1) {
+                hand_over(w, b);
+                break;
+            }
+            /* Fall through */
+        default:
+            if (malloc_usable_size(b->p) < b->size)
+                fail(w, "malloc_usable_size is too small", b);
+            check(w, b, b->size);
+        }
+    }
+
+    /* Once no thread hands blocks over any more, free what is left */
+    pthread_barrier_wait(&done);
+    drain(w);
+    for (s = 0; s < NSLOTS; s++)
+        if (w->slot[s].p != NULL)
+            drop(w, &w->slot[s]);
+    return NULL;
+}
+
+int main(int argc, char **argv)
+{
+    unsigned long seed = 1;
+    struct timeval start, end;
+    long handed = 0;
+    int c, i;
+
+    while ((c = getopt(argc, argv, "ht:n:a:S:")) != EOF) {
+        switch (c) {
+        case 't':
+            nthreads = atoi(optarg);
+            break;
+        case 'n':
+            nops = atol(optarg);
+            break;
+        case 'a':
+            min_align = strtoul(optarg, NULL, 0);
+            break;
+        case 'S':
+            seed = strtoul(optarg, NULL, 0);
+            break;
+        case 'h':
+            usage();
+            exit(0);
+        default:
+            usage();
+            exit(1);
+        }
+    }
+    if (optind != argc || nthreads < 1 || nthreads > MAX_THREADS ||
+        nops < 0 || min_align == 0 || (min_align & (min_align - 1))) {
+        usage();
+        exit(1);
+    }
+
+    gettimeofday(&start, NULL);
+    pthread_barrier_init(&done, NULL, nthreads);
+    for (i = 0; i < nthreads; i++) {
+        workers[i].id = i;
+        workers[i].rng = (seed * MAX_THREADS + i) * 2 + 1; /* never 0 */
+        pthread_mutex_init(&workers[i].lock, NULL);
+    }
+    for (i = 0; i < nthreads; i++)
+        if (pthread_create(&workers[i].tid, NULL, run, &workers[i]) != 0) {
+            fprintf(stderr, "mmstress: could not create thread %d\n", i);
+            exit(1);
+        }
+    for (i = 0; i < nthreads; i++) {
+        pthread_join(workers[i].tid, NULL);
+        handed += workers[i].handed;
+    }
+    gettimeofday(&end, NULL);
+
+    printf("mmstress: %d threads, %ld requests each, %ld blocks freed by "
+           "another thread, %.2f s\n", nthreads, nops, handed,
+           (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1e6);
+    return 0;
+}
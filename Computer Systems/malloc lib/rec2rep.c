@@ -0,0 +1,259 @@
+/*
+ * rec2rep.c - Turn a log written by the mmrecord recorder into an mdriver
+ * trace.
+ *
+ * Each block allocated in the log gets an id of its own, which follows
+ * it through reallocs to its free. A realloc to 0 bytes that freed its
+ * block becomes a free and a realloc of NULL an allocation; a request of
+ * 0 bytes becomes one of 1, as mdriver requires. Frees and reallocs of
+ * blocks the log did not see allocated, by libc before the recorder was
+ * loaded or by the parent of a forked process, are left out and counted.
+ */
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "record.h"
+
+#define NRECS 4096 /* records read at a time */
+
+/* A request of the trace */
+typedef struct {
+    char type;              /* 'a', 'r' or 'f' */
+    int id;
+    int size;
+} op_t;
+
+/* Block id of each live address: a hash table with linear probing */
+typedef struct {
+    unsigned long ptr;      /* 0 if the slot is empty */
+    int id;
+} slot_t;
+
+static slot_t *table;
+static unsigned long table_size, table_used; /* size is a power of 2 */
+
+/* The trace so far */
+static op_t *ops;
+static long nops, maxops;
+static int nids;
+
+/*
+ * usage - Explain the command line arguments
+ */
+static void usage(void)
+{
+    fprintf(stderr, "Usage: rec2rep [-h] [-o <out>] <log>\n");
+    fprintf(stderr, "Options\n");
+    fprintf(stderr, "\t-h         Print this message.\n");
+    fprintf(stderr, "\t-o <out>   Write the trace to <out> (default stdout).\n");
+    fprintf(stderr, "\t<log>      Log written by mmrecord.so.\n");
+}
+
+/*
+ * xrealloc - Allocate or grow an array, or give up
+ */
+static void *xrealloc(void *p, size_t size)
+{
+    if ((p = realloc(p, size)) == NULL) {
+        fprintf(stderr, "rec2rep: out of memory\n");
+        exit(1);
+    }
+    return p;
+}
+
+/*
+ * hash - Return the home slot of address ptr
+ */
+static unsigned long hash(unsigned long ptr)
+{
+    return ((ptr >> 4) * 0x9e3779b97f4a7c15UL >> 20) & (table_size - 1);
+}
+
+/*
+ * find - Return the slot of ptr, or the empty slot where it would go
+ */
+static slot_t *find(unsigned long ptr)
+{
+    unsigned long i;
+
+    for (i = hash(ptr); table[i].ptr != 0 && table[i].ptr != ptr;
+         i = (i + 1) & (table_size - 1))
+        ;
+    return &table[i];
+}
+
+/*
+ * insert - Make id the block at ptr
+ */
+static void insert(unsigned long ptr, int id)
+{
+    slot_t *old = table, *s;
+    unsigned long i, n = table_size;
+
+    if (2 * (table_used + 1) > table_size) { /* Grow to stay half empty */
+        table_size = n ? 2 * n : 1024;
+        table = calloc(table_size, sizeof(slot_t));
+        if (table == NULL) {
+            fprintf(stderr, "rec2rep: out of memory\n");
+            exit(1);
+        }
+        for (i = 0; i < n; i++)
+            if (old[i].ptr != 0)
+                *find(old[i].ptr) = old[i];
+        free(old);
+    }
+    s = find(ptr);
+    if (s->ptr == 0)
+        table_used++;
+    s->ptr = ptr;
+    s->id = id;
+}
+
+/*
+ * take - Remove ptr from the table; return its id, or -1 if it is not
+ *     there
+ */
+static int take(unsigned long ptr)
+{
+    slot_t *s;
+    unsigned long i, j, home;
+    int id;
+
+    if (table_size == 0 || (s = find(ptr))->ptr == 0)
+        return -1;
+    id = s->id;
+
+    /* Move back the entries after it that could no longer be found */
+    i = s - table;
+    for (j = (i + 1) & (table_size - 1); table[j].ptr != 0;
+         j = (j + 1) & (table_size - 1)) {
+        home = hash(table[j].ptr);
+        if (((j - home) & (table_size - 1)) >= ((j - i) & (table_size - 1))) {
+            table[i] = table[j];
+            i = j;
+        }
+    }
+    table[i].ptr = 0;
+    table_used--;
+    return id;
+}
+
+/*
+ * emit - Add a request to the trace
+ */
+static void emit(char type, int id, unsigned long size)
+{
+    if (nops == maxops) {
+        maxops = maxops ? 2 * maxops : 4096;
+        ops = xrealloc(ops, maxops * sizeof(op_t));
+    }
+    ops[nops].type = type;
+    ops[nops].id = id;
+    ops[nops++].size = (size == 0) ? 1 : (int)size;
+}
+
+int main(int argc, char **argv)
+{
+    rec_t recs[NRECS];
+    char *outfile = NULL;
+    long unknown = 0, big = 0;
+    size_t n, i;
+    int c, id;
+    FILE *fp;
+
+    while ((c = getopt(argc, argv, "ho:")) != EOF) {
+        switch (c) {
+        case 'o':
+            outfile = optarg;
+            break;
+        case 'h':
+            usage();
+            exit(0);
+        default:
+            usage();
+            exit(1);
+        }
+    }
+    if (optind != argc - 1) {
+        usage();
+        exit(1);
+    }
+    if ((fp = fopen(argv[optind], "rb")) == NULL) {
+        fprintf(stderr, "rec2rep: could not open %s\n", argv[optind]);
+        exit(1);
+    }
+
+    while ((n = fread(recs, sizeof(rec_t), NRECS, fp)) > 0) {
+        for (i = 0; i < n; i++) {
+            rec_t *r = &recs[i];
+
+            if (REC_SIZE(r) > INT_MAX) { /* mdriver reads an int */
+                big++;
+                if (REC_TYPE(r) == REC_REALLOC)
+                    take(r->old);
+                continue;
+            }
+            switch (REC_TYPE(r)) {
+            case REC_MALLOC:
+                take(r->ptr); /* Should not be there; its free was missed */
+                emit('a', nids, REC_SIZE(r));
+                insert(r->ptr, nids++);
+                break;
+
+            case REC_FREE:
+                if ((id = take(r->ptr)) < 0)
+                    unknown++;
+                else
+                    emit('f', id, 0);
+                break;
+
+            case REC_REALLOC:
+                if (r->old == 0 || (id = take(r->old)) < 0) {
+                    if (r->old != 0)
+                        unknown++;
+                    if (r->ptr != 0) { /* Count it as an allocation */
+                        emit('a', nids, REC_SIZE(r));
+                        insert(r->ptr, nids++);
+                    }
+                }
+                else if (r->ptr == 0) /* Freed by a realloc to 0 bytes */
+                    emit('f', id, 0);
+                else {
+                    emit('r', id, REC_SIZE(r));
+                    insert(r->ptr, id);
+                }
+                break;
+
+            default:
+                fprintf(stderr, "rec2rep: %s: bad record\n", argv[optind]);
+                exit(1);
+            }
+        }
+    }
+    fclose(fp);
+
+    if (outfile && (fp = fopen(outfile, "w")) == NULL) {
+        fprintf(stderr, "rec2rep: could not create %s\n", outfile);
+        exit(1);
+    }
+    else if (outfile == NULL)
+        fp = stdout;
+    fprintf(fp, "1\n%d\n%ld\n0\n", nids, nops);
+    for (i = 0; i < (size_t)nops; i++) {
+        if (ops[i].type == 'f')
+            fprintf(fp, "f %d\n", ops[i].id);
+        else
+            fprintf(fp, "%c %d %d\n", ops[i].type, ops[i].id, ops[i].size);
+    }
+    if (fp != stdout && fclose(fp) != 0) {
+        fprintf(stderr, "rec2rep: could not write %s\n", outfile);
+        exit(1);
+    }
+    fprintf(stderr, "rec2rep: %d blocks, %ld requests, %ld left out "
+            "(%ld of blocks not seen allocated, %ld over INT_MAX bytes)\n",
+            nids, nops, unknown + big, unknown, big);
+    return 0;
+}
@@ -0,0 +1,27 @@
+#ifndef __RECORD_H_
+#define __RECORD_H_
+
+/*
+ * record.h - Log format of the mmrecord allocation recorder, read by
+ *     rec2rep.
+ *
+ * The log is a sequence of rec_t in the order the calls returned, in
+ * the byte order of the machine that wrote it.
+ */
+
+#define REC_MALLOC  0 /* malloc, calloc and the aligned allocations */
+#define REC_FREE    1
+#define REC_REALLOC 2
+
+/* One allocator call */
+typedef struct {
+    unsigned long ptr;  /* block returned, or the block freed */
+    unsigned long old;  /* block passed to realloc */
+    unsigned long info; /* bytes asked for << 8 | REC_ type */
+} rec_t;
+
+#define REC_INFO(size, type) ((unsigned long)(size) << 8 | (type))
+#define REC_SIZE(r) ((r)->info >> 8)
+#define REC_TYPE(r) ((int)((r)->info & 0xff))
+
+#endif /* __RECORD_H_ */
@@ -0,0 +1,33 @@
+#ifndef __TRACE_H_
+#define __TRACE_H_
+
+/*
+ * trace.h - Compiled trace format, written by tracebin and loaded by
+ *     mdriver.
+ *
+ * A compiled trace is a trace_hdr_t followed by num_ops traceop_t
+ * records, in the byte order of the machine that wrote it. The records
+ * have the layout mdriver keeps the requests of a trace in, so mdriver
+ * maps the file and uses them where they lie: nothing is parsed, and
+ * worker processes reading the same trace share its pages.
+ */
+
+#define TRACE_MAGIC "mmtrace1" /* 8 bytes, no terminating null */
+
+/* Characterizes a single trace operation (allocator request) */
+typedef struct {
+    enum { ALLOC, FREE, REALLOC } type; /* type of request */
+    int index;                        /* index for free() to use later */
+    size_t size;                      /* byte size of alloc/realloc request */
+} traceop_t;
+
+/* Header of a compiled trace, the four numbers of a text trace header */
+typedef struct {
+    char magic[8];       /* TRACE_MAGIC */
+    int weight;          /* weight for this trace */
+    int num_ids;         /* number of alloc/realloc ids */
+    int num_ops;         /* number of distinct requests */
+    int ignore_ranges;   /* ignore-ranges flag */
+} trace_hdr_t;
+
+#endif /* __TRACE_H_ */
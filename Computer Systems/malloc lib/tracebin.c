@@ -0,0 +1,152 @@
+/*
+ * tracebin.c - Compile text trace files into the binary format of
+ * trace.h, which mdriver maps instead of parsing.
+ *
+ * Each <file> is written to <file>.bin, or to the file given with -o
+ * when there is only one. mdriver loads <trace>.bin in place of a text
+ * trace that is no newer than it, and accepts a compiled trace given
+ * with -f or -c directly.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "trace.h"
+
+#define MAXLINE 1024
+
+/*
+ * usage - Explain the command line arguments
+ */
+static void usage(void)
+{
+    fprintf(stderr, "Usage: tracebin [-h] [-o <out>] <file>...\n");
+    fprintf(stderr, "Options\n");
+    fprintf(stderr, "\t-h         Print this message.\n");
+    fprintf(stderr, "\t-o <out>   Write the compiled trace to <out>.\n");
+    fprintf(stderr, "\t<file>     Text trace, compiled to <file>.bin.\n");
+}
+
+/*
+ * compile - Compile the text trace in to the file out; return 0 on
+ *     success, -1 after printing why it failed
+ */
+static int compile(const char *in, const char *out)
+{
+    trace_hdr_t hdr;
+    traceop_t *ops;
+    char type[MAXLINE];
+    size_t size = 0;
+    int i, n, max_index = -1;
+    FILE *fp;
+
+    if ((fp = fopen(in, "r")) == NULL) {
+        fprintf(stderr, "tracebin: could not open %s\n", in);
+        return -1;
+    }
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, TRACE_MAGIC, sizeof(hdr.magic));
+    if (fscanf(fp, "%d %d %d %d", &hdr.weight, &hdr.num_ids, &hdr.num_ops,
+               &hdr.ignore_ranges) != 4 || hdr.num_ops < 0) {
+        fprintf(stderr, "tracebin: %s: bad header\n", in);
+        fclose(fp);
+        return -1;
+    }
+    if ((ops = calloc(hdr.num_ops ? hdr.num_ops : 1, sizeof(*ops))) == NULL) {
+        fprintf(stderr, "tracebin: out of memory\n");
+        exit(1);
+    }
+
+    /* Read the requests as read_trace() in mdriver does: a request
+       without a size gets that of the one before it */
+    for (i = 0; i < hdr.num_ops && fscanf(fp, "%s", type) == 1; i++) {
+        switch (type[0]) {
+        case 'a':
+        case 'r':
+            ops[i].type = (type[0] == 'a') ? ALLOC : REALLOC;
+            n = fscanf(fp, "%d", &ops[i].index) - 1;
+            if (fscanf(fp, "%zu", &size) == EOF)
+                n = -1;
+            ops[i].size = size;
+            break;
+        case 'f':
+            ops[i].type = FREE;
+            n = fscanf(fp, "%d", &ops[i].index) - 1;
+            break;
+        default:
+            n = -1;
+        }
+        if (n != 0 || ops[i].index >= hdr.num_ids ||
+            ops[i].index < (ops[i].type == FREE ? -1 : 0)) {
+            fprintf(stderr, "tracebin: %s: bad request %d\n", in, i);
+            fclose(fp);
+            free(ops);
+            return -1;
+        }
+        if (ops[i].index > max_index)
+            max_index = ops[i].index;
+    }
+    fclose(fp);
+    if (i != hdr.num_ops) {
+        fprintf(stderr, "tracebin: %s: %d requests in the header, %d found\n",
+                in, hdr.num_ops, i);
+        free(ops);
+        return -1;
+    }
+    if (max_index != hdr.num_ids - 1) {
+        fprintf(stderr, "tracebin: %s: %d ids in the header, %d used\n",
+                in, hdr.num_ids, max_index + 1);
+        free(ops);
+        return -1;
+    }
+
+    if ((fp = fopen(out, "wb")) == NULL) {
+        fprintf(stderr, "tracebin: could not create %s\n", out);
+        free(ops);
+        return -1;
+    }
+    if (fwrite(&hdr, sizeof(hdr), 1, fp) != 1 ||
+        fwrite(ops, sizeof(*ops), hdr.num_ops, fp) != (size_t)hdr.num_ops ||
+        fclose(fp) != 0) {
+        fprintf(stderr, "tracebin: could not write %s\n", out);
+        unlink(out);
+        free(ops);
+        return -1;
+    }
+    free(ops);
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    char out[MAXLINE];
+    char *outfile = NULL;
+    int c, status = 0;
+
+    while ((c = getopt(argc, argv, "ho:")) != EOF) {
+        switch (c) {
+        case 'o':
+            outfile = optarg;
+            break;
+        case 'h':
+            usage();
+            exit(0);
+        default:
+            usage();
+            exit(1);
+        }
+    }
+    if (optind == argc || (outfile && optind != argc - 1)) {
+        usage();
+        exit(1);
+    }
+
+    for (; optind < argc; optind++) {
+        if (outfile == NULL)
+            snprintf(out, sizeof(out), "%s.bin", argv[optind]);
+        if (compile(argv[optind], outfile ? outfile : out) < 0)
+            status = 1;
+    }
+    return status;
+}
@@ -0,0 +1,410 @@
+/*
+ * tracegen.c - Write a synthetic trace for mdriver, with the block sizes,
+ * lifetimes and reallocs drawn from distributions given on the command
+ * line, so the allocator can be run on workloads shaped like a real
+ * program's and much larger than the bundled traces.
+ *
+ * Time is counted in allocations: block i is allocated at time i, lives
+ * for a lifetime drawn from the -l distribution and is freed when its
+ * time is up. Meanwhile it may be reallocated (-r), each time growing by
+ * a factor. Whenever the live bytes exceed the -m target, the blocks
+ * closest to their end are freed early. Blocks still live after the last
+ * allocation are freed in order of their end at the end of the trace.
+ *
+ * A distribution is one of
+ *     fixed:<n>                    always n
+ *     uniform:<lo>:<hi>            uniform between lo and hi
+ *     exp:<mean>                   exponential
+ *     power:<lo>:<hi>:<alpha>      power law between lo and hi; the
+ *                                  smaller alpha, the heavier the tail
+ *     bimodal:<a>:<b>:<p>          around a, or around b with chance p,
+ *                                  each spread by 25% either way
+ *     hist:<file>                  empirical: lines of "<value> <weight>"
+ */
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define MAXLINE 1024
+#define MAX_REALLOCS 64     /* reallocs of one block */
+#define MAX_SIZE (1 << 30)  /* largest request, mdriver reads an int */
+
+/* A distribution to draw sizes or lifetimes from */
+typedef struct {
+    enum { FIXED, UNIFORM, EXP, POWER, BIMODAL, HIST } kind;
+    double a, b, c;         /* parameters, in the order of the spec */
+    int n;                  /* values of a histogram */
+    double *value, *cum;    /* histogram values and cumulative weights */
+} dist_t;
+
+/* A pending realloc or free of a block */
+typedef struct {
+    long time;              /* allocation count at which it happens */
+    long seq;               /* order of creation, to break ties */
+    int id;                 /* block */
+    char type;              /* 'r' or 'f' */
+} event_t;
+
+/* A request of the trace */
+typedef struct {
+    char type;              /* 'a', 'r' or 'f' */
+    int id;
+    int size;
+} op_t;
+
+static unsigned long rng_state = 1; /* xorshift64* state, set by -S */
+
+/* Events by time, a binary min-heap */
+static event_t *events;
+static long nevents, maxevents, nseq;
+
+/* The trace so far */
+static op_t *ops;
+static long nops, maxops;
+
+static int *cur_size;       /* size of each block, 0 once freed */
+static long live, peak;     /* live bytes now and at most */
+
+/*
+ * usage - Explain the command line arguments
+ */
+static void usage(void)
+{
+    fprintf(stderr, "Usage: tracegen [-h] [-n <blocks>] [-s <dist>] [-l <dist>]\n"
+            "                [-r <p>:<growth>] [-m <bytes>] [-S <seed>] [-o <file>]\n");
+    fprintf(stderr, "Options\n");
+    fprintf(stderr, "\t-h         Print this message.\n");
+    fprintf(stderr, "\t-n <n>     Allocate n blocks (default 100000).\n");
+    fprintf(stderr, "\t-s <dist>  Block sizes in bytes (default power:16:65536:1).\n");
+    fprintf(stderr, "\t-l <dist>  Block lifetimes in allocations (default exp:1000).\n");
+    fprintf(stderr, "\t-r <p>:<g> Realloc a block, again and again, with chance p,\n"
+            "\t           growing it by a factor g each time (default none).\n");
+    fprintf(stderr, "\t-m <bytes> Free blocks early once the live bytes exceed\n"
+            "\t           this (default 32 MB).\n");
+    fprintf(stderr, "\t-S <seed>  Seed of the random numbers (default 1).\n");
+    fprintf(stderr, "\t-o <file>  Write the trace to <file> (default stdout).\n");
+    fprintf(stderr, "Distributions: fixed:<n> uniform:<lo>:<hi> exp:<mean>\n"
+            "\tpower:<lo>:<hi>:<alpha> bimodal:<a>:<b>:<p> hist:<file>\n");
+}
+
+/*
+ * xrealloc - Allocate or grow an array, or give up
+ */
+static void *xrealloc(void *p, size_t size)
+{
+    if ((p = realloc(p, size)) == NULL) {
+        fprintf(stderr, "tracegen: out of memory\n");
+        exit(1);
+    }
+    return p;
+}
+
+/*
+ * rng - Return a random number in [0, 1)
+ */
+static double rng(void)
+{
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return ((rng_state * 0x2545f4914f6cdd1dUL) >> 11) * (1.0 / (1UL << 53));
+}
+
+/*
+ * read_hist - Read the "<value> <weight>" lines of file into d
+ */
+static int read_hist(dist_t *d, const char *file)
+{
+    char line[MAXLINE];
+    double v, w, sum = 0;
+    FILE *fp;
+
+    if ((fp = fopen(file, "r")) == NULL) {
+        fprintf(stderr, "tracegen: could not open %s\n", file);
+        return -1;
+    }
+    d->n = 0;
+    d->value = d->cum = NULL;
+    while (fgets(line, MAXLINE, fp) != NULL) {
+        if (line[0] == '#' || sscanf(line, "%lf %lf", &v, &w) != 2)
+            continue;
+        if (v < 0 || w < 0) {
+            fprintf(stderr, "tracegen: %s: negative value or weight\n", file);
+            fclose(fp);
+            return -1;
+        }
+        d->value = xrealloc(d->value, (d->n + 1) * sizeof(double));
+        d->cum = xrealloc(d->cum, (d->n + 1) * sizeof(double));
+        d->value[d->n] = v;
+        d->cum[d->n++] = sum += w;
+    }
+    fclose(fp);
+    if (sum <= 0) {
+        fprintf(stderr, "tracegen: %s: no weights\n", file);
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * parse_dist - Parse distribution spec into d; return 0, or -1 after
+ *     printing why spec is no good
+ */
+static int parse_dist(dist_t *d, const char *spec)
+{
+    int n = 0;
+
+    memset(d, 0, sizeof(*d));
+    if (strncmp(spec, "hist:", 5) == 0) {
+        d->kind = HIST;
+        return read_hist(d, spec + 5);
+    }
+    if (sscanf(spec, "fixed:%lf%n", &d->a, &n) == 1 && !spec[n])
+        d->kind = FIXED;
+    else if (sscanf(spec, "uniform:%lf:%lf%n", &d->a, &d->b, &n) == 2 &&
+             !spec[n] && d->a <= d->b)
+        d->kind = UNIFORM;
+    else if (sscanf(spec, "exp:%lf%n", &d->a, &n) == 1 && !spec[n])
+        d->kind = EXP;
+    else if (sscanf(spec, "power:%lf:%lf:%lf%n", &d->a, &d->b, &d->c, &n) == 3
+             && !spec[n] && d->a > 0 && d->a < d->b && d->c > 0)
+        d->kind = POWER;
+    else if (sscanf(spec, "bimodal:%lf:%lf:%lf%n", &d->a, &d->b, &d->c, &n)
+             == 3 && !spec[n] && d->c >= 0 && d->c <= 1)
+        d->kind = BIMODAL;
+    else {
+        fprintf(stderr, "tracegen: bad distribution %s\n", spec);
+        return -1;
+    }
+    if (d->a < 0 || d->b < 0) {
+        fprintf(stderr, "tracegen: negative value in %s\n", spec);
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * draw - Draw a value from distribution d
+ */
+static double draw(const dist_t *d)
+{
+    double u = rng(), r;
+    int lo, hi, mid;
+
+    switch (d->kind) {
+    case FIXED:
+        return d->a;
+    case UNIFORM:
+        return d->a + u * (d->b - d->a);
+    case EXP:
+        return -d->a * log(1 - u);
+    case POWER: /* Inverse of the bounded Pareto distribution function */
+        r = pow(d->a / d->b, d->c);
+        return d->a * pow(1 - u * (1 - r), -1 / d->c);
+    case BIMODAL:
+        return ((u < d->c) ? d->b : d->a) * (0.75 + 0.5 * rng());
+    case HIST:
+        u *= d->cum[d->n - 1];
+        for (lo = 0, hi = d->n - 1; lo < hi; ) {
+            mid = (lo + hi) / 2;
+            if (d->cum[mid] > u)
+                hi = mid;
+            else
+                lo = mid + 1;
+        }
+        return d->value[lo];
+    }
+    return 0;
+}
+
+/*
+ * draw_size - Draw a request size from d
+ */
+static int draw_size(const dist_t *d)
+{
+    double v = draw(d);
+
+    return (v < 1) ? 1 : (v > MAX_SIZE) ? MAX_SIZE : (int)v;
+}
+
+/*
+ * push_event - Schedule a realloc or free of block id at time
+ */
+static void push_event(long time, int id, char type)
+{
+    event_t e = { time, nseq++, id, type };
+    long i, parent;
+
+    if (nevents == maxevents) {
+        maxevents = maxevents ? 2 * maxevents : 1024;
+        events = xrealloc(events, maxevents * sizeof(event_t));
+    }
+    for (i = nevents++; i > 0; i = parent) {
+        parent = (i - 1) / 2;
+        if (events[parent].time < e.time ||
+            (events[parent].time == e.time && events[parent].seq < e.seq))
+            break;
+        events[i] = events[parent];
+    }
+    events[i] = e;
+}
+
+/*
+ * pop_event - Remove the earliest event and return it
+ */
+static event_t pop_event(void)
+{
+    event_t top = events[0], e = events[--nevents];
+    long i, child;
+
+    for (i = 0; (child = 2 * i + 1) < nevents; i = child) {
+        if (child + 1 < nevents && (events[child + 1].time < events[child].time
+            || (events[child + 1].time == events[child].time &&
+                events[child + 1].seq < events[child].seq)))
+            child++;
+        if (e.time < events[child].time ||
+            (e.time == events[child].time && e.seq < events[child].seq))
+            break;
+        events[i] = events[child];
+    }
+    events[i] = e;
+    return top;
+}
+
+/*
+ * emit - Add a request to the trace and track the live bytes
+ */
+static void emit(char type, int id, int size)
+{
+    if (nops == maxops) {
+        maxops = maxops ? 2 * maxops : 4096;
+        ops = xrealloc(ops, maxops * sizeof(op_t));
+    }
+    ops[nops].type = type;
+    ops[nops].id = id;
+    ops[nops++].size = size;
+    live += size - cur_size[id];
+    cur_size[id] = size;
+    if (live > peak)
+        peak = live;
+}
+
+/*
+ * run_event - Carry out event e
+ */
+static void run_event(event_t e, double growth)
+{
+    double size = cur_size[e.id] * growth;
+
+    if (e.type == 'f')
+        emit('f', e.id, 0);
+    else
+        emit('r', e.id, (size < 1) ? 1 : (size > MAX_SIZE) ? MAX_SIZE :
+             (int)size);
+}
+
+int main(int argc, char **argv)
+{
+    dist_t sizes, lifetimes;
+    double p_realloc = 0, growth = 1;
+    long nblocks = 100000, target = 32L << 20;
+    long i, end, times[MAX_REALLOCS];
+    char *outfile = NULL;
+    int c, k, j, n;
+    FILE *fp = stdout;
+
+    parse_dist(&sizes, "power:16:65536:1");
+    parse_dist(&lifetimes, "exp:1000");
+    while ((c = getopt(argc, argv, "hn:s:l:r:m:S:o:")) != EOF) {
+        switch (c) {
+        case 'n':
+            nblocks = atol(optarg);
+            break;
+        case 's':
+            if (parse_dist(&sizes, optarg) < 0)
+                exit(1);
+            break;
+        case 'l':
+            if (parse_dist(&lifetimes, optarg) < 0)
+                exit(1);
+            break;
+        case 'r':
+            if (sscanf(optarg, "%lf:%lf%n", &p_realloc, &growth, &n) != 2 ||
+                optarg[n] || p_realloc < 0 || p_realloc >= 1 || growth <= 0) {
+                fprintf(stderr, "tracegen: bad realloc spec %s\n", optarg);
+                exit(1);
+            }
+            break;
+        case 'm':
+            target = atol(optarg);
+            break;
+        case 'S':
+            rng_state = strtoul(optarg, NULL, 0) * 2 + 1; /* never 0 */
+            break;
+        case 'o':
+            outfile = optarg;
+            break;
+        case 'h':
+            usage();
+            exit(0);
+        default:
+            usage();
+            exit(1);
+        }
+    }
+    if (optind != argc || nblocks <= 0 || nblocks > 0x7fffffff || target <= 0) {
+        usage();
+        exit(1);
+    }
+    cur_size = xrealloc(NULL, nblocks * sizeof(int));
+    memset(cur_size, 0, nblocks * sizeof(int));
+
+    for (i = 0; i < nblocks; i++) {
+        /* Carry out what is due by now */
+        while (nevents > 0 && events[0].time <= i)
+            run_event(pop_event(), growth);
+
+        emit('a', i, draw_size(&sizes));
+        end = i + 1 + (long)draw(&lifetimes);
+
+        /* Spread the reallocs of the block over its life */
+        for (k = 0; k < MAX_REALLOCS && rng() < p_realloc; k++) {
+            times[k] = i + 1 + (long)(rng() * (end - i - 1));
+            for (j = k; j > 0 && times[j - 1] > times[j]; j--) {
+                long t = times[j];
+                times[j] = times[j - 1];
+                times[j - 1] = t;
+            }
+        }
+        for (j = 0; j < k; j++)
+            push_event(times[j], i, 'r');
+        push_event(end, i, 'f');
+
+        /* Over the target, bring forward the earliest ends */
+        while (live > target && nevents > 0)
+            run_event(pop_event(), growth);
+    }
+    while (nevents > 0)
+        run_event(pop_event(), growth);
+
+    if (outfile && (fp = fopen(outfile, "w")) == NULL) {
+        fprintf(stderr, "tracegen: could not create %s\n", outfile);
+        exit(1);
+    }
+    fprintf(fp, "1\n%ld\n%ld\n0\n", nblocks, nops);
+    for (i = 0; i < nops; i++) {
+        if (ops[i].type == 'f')
+            fprintf(fp, "f %d\n", ops[i].id);
+        else
+            fprintf(fp, "%c %d %d\n", ops[i].type, ops[i].id, ops[i].size);
+    }
+    if (fp != stdout && fclose(fp) != 0) {
+        fprintf(stderr, "tracegen: could not write %s\n", outfile);
+        exit(1);
+    }
+    fprintf(stderr, "tracegen: %ld blocks, %ld requests, %ld live bytes at "
+            "most\n", nblocks, nops, peak);
+    return 0;
+}